@@ -0,0 +1,102 @@
+#include "chip.h"
+#include "lanes.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * libFuzzer target for the core.
+ * an input is FUZZ_KEY_BYTES of key events followed by a rom. one event is
+ * applied every FUZZ_FRAMES_PER_KEY frames: the low nibble is the key, the
+ * top bit says pressed or released. bits 4-5 of the first two events pick
+ * the CHIP_QUIRK_* flags.
+ * the rom runs on every lane of a chip_lanes at once. lane i reads the events
+ * rotated by i and seeds its rng with FUZZ_SEED + i, so lanes split on keys,
+ * quirks and RND and rejoin when the rom ignores them. each lane has its own
+ * scalar core and must match it after every frame, which covers the masked
+ * groups, the CHIP_LANES_DIVERGED fallback and lanes dying mid frame.
+ */
+
+#define FUZZ_KEY_BYTES      16
+#define FUZZ_FRAMES_PER_KEY 4
+#define FUZZ_CYCLES         12
+#define FUZZ_SEED           0x8badf00d
+
+static struct chip scalar[CHIP_LANES];
+static struct chip lane_out;
+static struct chip_lanes lanes;
+
+static uint8_t lane_event(const uint8_t *events, int lane, int n) {
+    return events[(n + lane) % FUZZ_KEY_BYTES];
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size < FUZZ_KEY_BYTES) return 0;
+
+    const uint8_t *events = data;
+    const uint8_t *rom = data + FUZZ_KEY_BYTES;
+    size_t rom_size = size - FUZZ_KEY_BYTES;
+
+    chip_lanes_reset(&lanes);
+    for (int lane = 0; lane < CHIP_LANES; lane++) {
+        struct chip *c = &scalar[lane];
+        chip_reset(c, FUZZ_SEED + lane);
+        c->quirks = ((lane_event(events, lane, 0) >> 4) & 0x3) | ((lane_event(events, lane, 1) >> 4) & 0x3) << 2;
+        if (chip_load(c, rom, rom_size) != 0) return 0;
+        chip_lanes_set(&lanes, lane, c);
+    }
+
+    uint32_t running = lanes.active;
+    for (int frame = 0; frame < FUZZ_KEY_BYTES * FUZZ_FRAMES_PER_KEY && running; frame++) {
+        if (frame % FUZZ_FRAMES_PER_KEY == 0) {
+            for (int lane = 0; lane < CHIP_LANES; lane++) {
+                uint8_t e = lane_event(events, lane, frame / FUZZ_FRAMES_PER_KEY);
+                chip_key(&scalar[lane], e & 0xF, e >> 7);
+                chip_lanes_key(&lanes, lane, e & 0xF, e >> 7);
+            }
+        }
+
+        // stopped lanes stay frozen, but their timers still run down like the lanes' do
+        for (int lane = 0; lane < CHIP_LANES; lane++) {
+            for (int i = 0; i < FUZZ_CYCLES && (running >> lane & 1); i++) {
+                if (chip_cycle(&scalar[lane]).decode_status < 0) running &= ~(1u << lane);
+            }
+            decrement_timers(&scalar[lane]);
+        }
+
+        chip_lanes_frame(&lanes, FUZZ_CYCLES);
+
+        for (int lane = 0; lane < CHIP_LANES; lane++) {
+            chip_lanes_get(&lanes, lane, &lane_out);
+            if ((running >> lane & 1) != (lanes.active >> lane & 1) || memcmp(&scalar[lane], &lane_out, sizeof(lane_out)) != 0) {
+                fprintf(stderr, "lane %d diverged from the scalar core in frame %d\n", lane, frame);
+                abort();
+            }
+        }
+    }
+
+    return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+/* replays inputs without libFuzzer, for compilers that don't ship it */
+int main(int argc, char *argv[]) {
+    static uint8_t buf[FUZZ_KEY_BYTES + CHIP_8_RAM];
+
+    for (int i = 1; i < argc; i++) {
+        FILE *f = fopen(argv[i], "rb");
+        if (!f) {
+            printf("ERROR: File %s could not be loaded.\n", argv[i]);
+            return 1;
+        }
+        size_t size = fread(buf, 1, sizeof(buf), f);
+        fclose(f);
+
+        LLVMFuzzerTestOneInput(buf, size);
+    }
+    return 0;
+}
+#endif
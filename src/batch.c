@@ -0,0 +1,536 @@
+#include "batch.h"
+#include "chip.h"
+#include "hash.h"
+#include "romdb.h"
+#include "debug.h"
+#include "capture.h"
+#include "perf.h"
+#include "workers.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * headless batch runner.
+ * every rom runs on its own chip instance for a fixed number of frames, and
+ * the final framebuffer hash is compared against <rom>.golden.
+ * jobs are spread over one work-stealing deque per worker thread.
+ */
+
+enum batch_status {
+    BATCH_PASS,
+    BATCH_FAIL,
+    BATCH_NEW,          /* no golden to compare against */
+    BATCH_UPDATED,      /* golden written */
+    BATCH_ERROR,        /* rom failed to load or hit an illegal instruction */
+};
+
+static const char *batch_status_names[] = {"PASS", "FAIL", "NEW", "UPDATED", "ERROR"};
+
+struct batch_job {
+    char *path;
+    size_t name;        /* offset of the part of path below the batch root */
+    int frames;
+    int ran;            /* frames it actually ran, fewer if it halted or failed */
+    uint64_t hash;
+    uint64_t ns;
+    uint64_t cpu_ns;    /* time the worker thread spent on it */
+    enum batch_status status;
+    int opcode;         /* the illegal instruction it hit, or -1 */
+    int load;           /* CHIP_ERROR_* if the rom failed to load */
+};
+
+struct batch_list {
+    struct batch_job *jobs;
+    size_t count;
+    size_t cap;
+};
+
+/*
+ * Chase-Lev deque over a fixed slice of job indices.
+ * all jobs are handed out before the workers start, so the owner only ever
+ * pops from the bottom and thieves take from the top.
+ */
+struct batch_deque {
+    _Atomic long top;
+    _Atomic long bottom;
+    int *items;
+};
+
+struct batch_worker {
+    int id;
+    struct batch_deque deque;
+    struct batch_pool *pool;
+};
+
+struct batch_pool {
+    struct batch_list *list;
+    struct batch_options *opts;
+    struct batch_worker *workers;
+    int count;
+};
+
+#define BATCH_EMPTY    -1
+#define BATCH_ABORT    -2  /* lost a race, try again */
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t cpu_ns() {
+    // of the calling thread, so oversubscribed workers don't count time spent waiting for a core
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int deque_pop(struct batch_deque *d) {
+    long b = atomic_load(&d->bottom) - 1;
+    atomic_store(&d->bottom, b);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load(&d->top);
+
+    if (t > b) {
+        // already empty
+        atomic_store(&d->bottom, b + 1);
+        return BATCH_EMPTY;
+    }
+
+    int item = d->items[b];
+    if (t == b) {
+        // last item, race the thieves for it
+        if (!atomic_compare_exchange_strong(&d->top, &t, t + 1))
+            item = BATCH_EMPTY;
+        atomic_store(&d->bottom, b + 1);
+    }
+    return item;
+}
+
+static int deque_steal(struct batch_deque *d) {
+    long t = atomic_load(&d->top);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load(&d->bottom);
+
+    if (t >= b)
+        return BATCH_EMPTY;
+
+    int item = d->items[t];
+    if (!atomic_compare_exchange_strong(&d->top, &t, t + 1))
+        return BATCH_ABORT;
+    return item;
+}
+
+static int list_add(struct batch_list *list, const char *path, size_t name, int frames) {
+    if (list->count == list->cap) {
+        size_t cap = list->cap ? list->cap * 2 : 64;
+        struct batch_job *jobs = realloc(list->jobs, cap * sizeof(*jobs));
+        if (!jobs) {
+            printf("ERROR: Failed to allocate job list.\n");
+            return -1;
+        }
+        list->jobs = jobs;
+        list->cap = cap;
+    }
+
+    struct batch_job *job = &list->jobs[list->count++];
+    memset(job, 0, sizeof(*job));
+    job->path = strdup(path);
+    job->name = name;
+    job->frames = frames;
+    job->opcode = -1;
+    // until a worker finishes it. a job nobody ran must not count as a pass
+    job->status = BATCH_ERROR;
+    return job->path ? 0 : -1;
+}
+
+static int is_rom(const char *name) {
+    // by extension, so readmes and our own goldens and recordings are left alone
+    static const char *exts[] = {".ch8", ".c8", ".sc8", ".xo8"};
+    size_t len = strlen(name);
+    for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); i++) {
+        size_t n = strlen(exts[i]);
+        if (len > n && strcasecmp(name + len - n, exts[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+static int scan_dir(struct batch_list *list, const char *dir, size_t root, int frames) {
+    DIR *d = opendir(dir);
+    if (!d) {
+        printf("ERROR: Directory %s could not be opened.\n", dir);
+        return -1;
+    }
+
+    struct dirent *e;
+    while ((e = readdir(d))) {
+        // skip hidden files, . and ..
+        if (e->d_name[0] == '.')
+            continue;
+
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+
+        // symlinks to roms are followed, symlinks to directories are not,
+        // so a link back up the tree can't queue the same roms forever
+        struct stat st;
+        if (lstat(path, &st) != 0)
+            continue;
+        if (S_ISLNK(st.st_mode) && (stat(path, &st) != 0 || S_ISDIR(st.st_mode)))
+            continue;
+
+        if (S_ISDIR(st.st_mode)) {
+            if (scan_dir(list, path, root, frames) != 0) {
+                closedir(d);
+                return -1;
+            }
+        } else if (S_ISREG(st.st_mode) && is_rom(e->d_name)) {
+            if (list_add(list, path, root, frames) != 0) {
+                closedir(d);
+                return -1;
+            }
+        }
+    }
+
+    closedir(d);
+    return 0;
+}
+
+static int scan_manifest(struct batch_list *list, const char *manifest, int frames) {
+    /*
+     * one rom per line, optionally followed by a frame count:
+     *   games/pong.ch8 1200
+     * relative paths are taken from the manifest's directory. # starts a comment.
+     */
+    FILE *f = fopen(manifest, "r");
+    if (!f) {
+        printf("ERROR: Manifest %s could not be loaded.\n", manifest);
+        return -1;
+    }
+
+    char base[4096];
+    snprintf(base, sizeof(base), "%s", manifest);
+    char *slash = strrchr(base, '/');
+    if (slash) *slash = '\0';
+    else strcpy(base, ".");
+
+    char line[4096];
+    while (fgets(line, sizeof(line), f)) {
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+
+        char rom[4096];
+        int rom_frames = frames;
+        if (sscanf(line, "%4095s %d", rom, &rom_frames) < 1)
+            continue;
+
+        char path[4096 * 2];
+        if (rom[0] == '/') snprintf(path, sizeof(path), "%s", rom);
+        else snprintf(path, sizeof(path), "%s/%s", base, rom);
+
+        size_t name = rom[0] == '/' ? 1 : strlen(base) + 1;
+        if (list_add(list, path, name, rom_frames) != 0) {
+            fclose(f);
+            return -1;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+static int compare_jobs(const void *a, const void *b) {
+    return strcmp(((const struct batch_job *) a)->path, ((const struct batch_job *) b)->path);
+}
+
+static int read_golden(const char *path, uint64_t *out) {
+    char golden[4096 + sizeof(BATCH_GOLDEN_EXT)];
+    snprintf(golden, sizeof(golden), "%s%s", path, BATCH_GOLDEN_EXT);
+
+    FILE *f = fopen(golden, "r");
+    if (!f) return -1;
+
+    unsigned long long v;
+    int n = fscanf(f, "%llx", &v);
+    fclose(f);
+    if (n != 1) return -1;
+
+    *out = v;
+    return 0;
+}
+
+static int write_golden(const char *path, uint64_t hash) {
+    char golden[4096 + sizeof(BATCH_GOLDEN_EXT)];
+    snprintf(golden, sizeof(golden), "%s%s", path, BATCH_GOLDEN_EXT);
+
+    FILE *f = fopen(golden, "w");
+    if (!f) return -1;
+    fprintf(f, "%016llx\n", (unsigned long long) hash);
+    fclose(f);
+    return 0;
+}
+
+static struct capture *open_capture(struct batch_job *job, struct batch_options *opts, const uint32_t *palette) {
+    // named after the rom's path below the batch root with / as _, so roms
+    // of the same name in different directories don't share a recording
+    char base[4096];
+    int dir = snprintf(base, sizeof(base), "%s/", opts->capture_dir);
+    snprintf(base + dir, sizeof(base) - dir, "%s", job->path + job->name);
+    for (char *s = base + dir; *s; s++)
+        if (*s == '/') *s = '_';
+
+    struct capture *cap = malloc(sizeof(*cap));
+    if (!cap) {
+        printf("ERROR: Failed to allocate capture.\n");
+        return NULL;
+    }
+    // nothing to keep pace with headless, so wait for the writer instead of dropping
+    if (capture_open(cap, base, opts->capture_scale, palette, 0) != 0) {
+        free(cap);
+        return NULL;
+    }
+    return cap;
+}
+
+static void run_job(struct batch_job *job, struct chip *c, struct batch_options *opts, struct debug *dbg, struct perf *perf) {
+    uint64_t start = now_ns();
+    uint64_t cpu_start = cpu_ns();
+
+    if ((job->load = chip_init(c, job->path, BATCH_SEED)) != 0) {
+        job->status = BATCH_ERROR;
+        job->ns = now_ns() - start;
+        job->cpu_ns = cpu_ns() - cpu_start;
+        return;
+    }
+
+    int cycles = opts->cycles_per_frame;
+    uint32_t quirks = opts->quirks;
+    const struct romdb_entry *e = romdb_find(opts->db, romdb_hash(c));
+    uint32_t palette[PALETTE_COLORS] = {PALETTE_BACKGROUND, PALETTE_FOREGROUND, PALETTE_PLANE_2, PALETTE_BLEND};
+    if (opts->palette) memcpy(palette, opts->palette, sizeof(palette));
+    if (e) romdb_apply(e, opts->keep, &cycles, &quirks, palette);
+    c->quirks = quirks;
+
+    struct capture *cap = NULL;
+    int ok = 1;
+    if (opts->capture_dir && !(cap = open_capture(job, opts, palette))) ok = 0;
+
+    if (dbg) debug_attach(dbg, job->path);
+
+    // loading the rom is not part of any frame
+    uint64_t frame_start = perf ? now_ns() : 0;
+    if (perf) perf->mark = frame_start;
+    for (int frame = 0; frame < job->frames && ok && !c->halted; frame++) {
+        struct chip_return r = chip_run(c, cycles, dbg);
+        if (r.decode_status < 0) {
+            job->opcode = r.opcode;
+            ok = 0;
+        }
+        if (cap) capture_frame(cap, c);
+        decrement_timers(c);
+        job->ran++;
+
+        if (perf) {
+            // headless is all emulation, one timestamp a frame
+            uint64_t now = now_ns();
+            perf_emulated(perf, 1, cycles);
+            perf_phase(perf, PERF_EMULATE, now);
+            perf_frame(perf, now - frame_start);
+            frame_start = now;
+            if (perf_report(perf, now, -1)) perf_print(&perf->last, stderr, job->path);
+        }
+    }
+
+    if (dbg) debug_attach(dbg, NULL);
+    if (cap) capture_close(cap);
+    free(cap);
+
+    job->hash = hash64(c->planes, sizeof(c->planes), 0);
+
+    if (!ok) {
+        job->status = BATCH_ERROR;
+    } else if (opts->update) {
+        job->status = write_golden(job->path, job->hash) == 0 ? BATCH_UPDATED : BATCH_ERROR;
+    } else {
+        uint64_t golden;
+        if (read_golden(job->path, &golden) != 0) job->status = BATCH_NEW;
+        else job->status = golden == job->hash ? BATCH_PASS : BATCH_FAIL;
+    }
+
+    job->ns = now_ns() - start;
+    job->cpu_ns = cpu_ns() - cpu_start;
+}
+
+static int next_job(struct batch_worker *w) {
+    int job = deque_pop(&w->deque);
+    if (job >= 0) return job;
+
+    // our deque is dry, go steal. keep sweeping while anyone lost a race,
+    // since that means there may still be work left.
+    struct batch_pool *pool = w->pool;
+    int contended;
+    do {
+        contended = 0;
+        for (int i = 1; i < pool->count; i++) {
+            struct batch_worker *victim = &pool->workers[(w->id + i) % pool->count];
+            job = deque_steal(&victim->deque);
+            if (job >= 0) return job;
+            if (job == BATCH_ABORT) contended = 1;
+        }
+    } while (contended);
+
+    return BATCH_EMPTY;
+}
+
+static void *worker_main(void *arg) {
+    struct batch_worker *w = arg;
+
+    // one machine per worker, reused for every rom it runs
+    struct chip *c = malloc(sizeof(*c));
+    if (!c) {
+        printf("ERROR: Failed to allocate chip.\n");
+        return NULL;
+    }
+
+    // a debugger per worker, so any running rom can be stopped and looked at
+    struct debug *dbg = NULL;
+    const char *debug_path = w->pool->opts->debug_path;
+    if (debug_path) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s.%d", debug_path, w->id);
+        dbg = malloc(sizeof(*dbg));
+        if (!dbg || debug_open(dbg, path) != 0) {
+            free(dbg);
+            dbg = NULL;
+        }
+    }
+
+    // frame timing per worker, so nothing is shared between them
+    struct perf *perf = NULL;
+    if (w->pool->opts->perf) {
+        perf = malloc(sizeof(*perf));
+        if (perf) perf_start(perf, now_ns());
+    }
+
+    int job;
+    while ((job = next_job(w)) >= 0)
+        run_job(&w->pool->list->jobs[job], c, w->pool->opts, dbg, perf);
+
+    if (dbg) debug_close(dbg);
+    free(dbg);
+    free(perf);
+    free(c);
+    return NULL;
+}
+
+static void print_report(struct batch_list *list, int threads, uint64_t wall_ns) {
+    int counts[BATCH_ERROR + 1] = {0};
+    uint64_t cpu = 0;
+    uint64_t frames = 0;
+
+    for (size_t i = 0; i < list->count; i++) {
+        struct batch_job *job = &list->jobs[i];
+        counts[job->status]++;
+        cpu += job->cpu_ns;
+        frames += job->ran;
+
+        printf("%-7s %9.3f ms  %016llx  %s",
+                batch_status_names[job->status],
+                job->ns / 1e6,
+                (unsigned long long) job->hash,
+                job->path);
+        // reported here rather than from the workers, so lines never interleave
+        if (job->opcode >= 0) printf("  (illegal instruction %04X)", job->opcode);
+        if (job->load) printf("  (%s)", chip_error(job->load));
+        printf("\n");
+    }
+
+    double wall = wall_ns / 1e9;
+    printf("\n%zu roms on %d threads in %.3f s (%.3f s cpu, %.2fx parallel, %.0f frames/s)\n",
+            list->count, threads, wall, cpu / 1e9,
+            wall > 0 ? cpu / 1e9 / wall : 0.0,
+            wall > 0 ? frames / wall : 0.0);
+    printf("pass: %d  fail: %d  new: %d  updated: %d  error: %d\n",
+            counts[BATCH_PASS], counts[BATCH_FAIL], counts[BATCH_NEW],
+            counts[BATCH_UPDATED], counts[BATCH_ERROR]);
+}
+
+int batch_run(char *path, struct batch_options *opts) {
+    struct batch_list list = {0};
+
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        printf("ERROR: File %s could not be loaded.\n", path);
+        return -1;
+    }
+
+    int scanned;
+    if (S_ISDIR(st.st_mode)) {
+        scanned = scan_dir(&list, path, strlen(path) + 1, opts->frames);
+        // readdir order is arbitrary, keep reports diffable between runs
+        if (scanned == 0) qsort(list.jobs, list.count, sizeof(*list.jobs), compare_jobs);
+    } else {
+        scanned = scan_manifest(&list, path, opts->frames);
+    }
+
+    int threads = opts->threads;
+    if (threads <= 0) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+    if ((size_t) threads > list.count) threads = list.count ? (int) list.count : 1;
+
+    struct batch_pool pool = {&list, opts, NULL, threads};
+    int *items = malloc((list.count + 1) * sizeof(*items));
+    pool.workers = calloc(threads, sizeof(*pool.workers));
+    if (scanned != 0 || !items || !pool.workers) {
+        if (scanned == 0) printf("ERROR: Failed to allocate worker pool.\n");
+        free(items);
+        free(pool.workers);
+        for (size_t i = 0; i < list.count; i++) free(list.jobs[i].path);
+        free(list.jobs);
+        return -1;
+    }
+
+    // hand each worker a contiguous slice. stealing evens out the slow roms.
+    for (size_t i = 0; i < list.count; i++) items[i] = (int) i;
+    for (int i = 0; i < threads; i++) {
+        struct batch_worker *w = &pool.workers[i];
+        w->id = i;
+        w->pool = &pool;
+        w->deque.items = items;
+        atomic_init(&w->deque.top, (long) (list.count * i / threads));
+        atomic_init(&w->deque.bottom, (long) (list.count * (i + 1) / threads));
+    }
+
+    uint64_t start = now_ns();
+
+    // worker 0 runs on this thread. a worker that fails to start has its jobs stolen by the rest
+    struct workers running;
+    workers_start(&running, threads, worker_main, pool.workers, sizeof(*pool.workers));
+    worker_main(&pool.workers[0]);
+    workers_join(&running);
+
+    uint64_t wall_ns = now_ns() - start;
+
+    print_report(&list, threads, wall_ns);
+
+    int failed = 0;
+    for (size_t i = 0; i < list.count; i++) {
+        if (list.jobs[i].status == BATCH_FAIL || list.jobs[i].status == BATCH_ERROR) failed = 1;
+        free(list.jobs[i].path);
+    }
+    free(list.jobs);
+    free(items);
+    free(pool.workers);
+
+    return failed ? 1 : 0;
+}
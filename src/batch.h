@@ -0,0 +1,29 @@
+#ifndef BATCH
+#define BATCH
+
+#include <stdint.h>
+
+#define BATCH_DEFAULT_FRAMES        600     /* ten seconds of emulated time per rom */
+#define BATCH_SEED                  0x8badf00d  /* fixed CXNN seed so goldens are reproducible */
+#define BATCH_GOLDEN_EXT            ".golden"
+
+struct romdb;
+
+struct batch_options {
+    int frames;             /* frames to run each rom for */
+    int cycles_per_frame;   /* chip-8 instructions per frame */
+    uint32_t quirks;        /* CHIP_QUIRK_* flags */
+    int keep;               /* ROMDB_* settings the rom database must not override */
+    const struct romdb *db; /* per-rom settings, looked up by content hash */
+    int threads;            /* worker threads. 0 picks one per core */
+    int update;             /* write goldens instead of comparing against them */
+    const char *debug_path; /* if set, worker N serves a debugger on <debug_path>.N */
+    const char *capture_dir; /* if set, each rom is recorded to <capture_dir>/<rom path, / as _>.y4m and .wav */
+    int capture_scale;      /* recorded pixels per hires pixel */
+    const uint32_t *palette; /* colors recordings start from, before the rom database */
+    int perf;               /* print each worker's frame timing to stderr once a second */
+};
+
+int batch_run(char *path, struct batch_options *opts);
+
+#endif
@@ -0,0 +1,267 @@
+#include "capture.h"
+#include "chip.h"
+#include "sound.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#define CAPTURE_WIDTH(cap)      (CHIP_8_HIRES_WIDTH * (cap)->scale)
+#define CAPTURE_HEIGHT(cap)     (CHIP_8_HIRES_HEIGHT * (cap)->scale)
+#define CAPTURE_STREAMING       0xFFFFFFFF  /* wav size while unknown, players read to the end */
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, v);
+    put16(p + 2, v >> 16);
+}
+
+static int write_wav_header(FILE *f, uint32_t data_size) {
+    // 16 bit mono pcm at the rate we play at
+    uint8_t h[44];
+    memcpy(h, "RIFF", 4);
+    put32(h + 4, data_size == CAPTURE_STREAMING ? CAPTURE_STREAMING : data_size + 36);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(h + 16, 16);
+    put16(h + 20, 1);
+    put16(h + 22, 1);
+    put32(h + 24, SOUND_SAMPLE_RATE);
+    put32(h + 28, SOUND_SAMPLE_RATE * 2);
+    put16(h + 32, 2);
+    put16(h + 34, 16);
+    memcpy(h + 36, "data", 4);
+    put32(h + 40, data_size);
+    return fwrite(h, sizeof(h), 1, f) == 1 ? 0 : -1;
+}
+
+static void palette_to_yuv(const uint32_t *palette, uint8_t yuv[PALETTE_COLORS][3]) {
+    // bt.601, studio range, which is what y4m readers assume
+    for (int i=0; i<PALETTE_COLORS; i++) {
+        float r = (palette[i] >> 16) & 0xFF;
+        float g = (palette[i] >> 8) & 0xFF;
+        float b = palette[i] & 0xFF;
+        yuv[i][0] = 16.5f + (65.738f * r + 129.057f * g + 25.064f * b) / 256.0f;
+        yuv[i][1] = 128.5f + (-37.945f * r - 74.494f * g + 112.439f * b) / 256.0f;
+        yuv[i][2] = 128.5f + (112.439f * r - 94.154f * g - 18.285f * b) / 256.0f;
+    }
+}
+
+static int write_picture(struct capture *cap) {
+    // always 128x64 times scale, lores pixels are doubled, so the size never changes
+    int w = CAPTURE_WIDTH(cap);
+    int h = CAPTURE_HEIGHT(cap);
+    size_t plane_size = (size_t) w * h;
+    int hires = cap->shown.hires;
+
+    for (int y=0; y<CHIP_8_HIRES_HEIGHT; y++) {
+        int row = hires ? y : y / 2;
+        chip_row p0 = cap->planes[0][row];
+        chip_row p1 = cap->planes[1][row];
+
+        uint8_t *line[3];
+        for (int k=0; k<3; k++)
+            line[k] = cap->picture + k * plane_size + (size_t) y * cap->scale * w;
+
+        for (int x=0; x<CHIP_8_HIRES_WIDTH; x++) {
+            int shift = CHIP_8_HIRES_WIDTH - 1 - (hires ? x : x / 2);
+            const uint8_t *color = cap->yuv[((p0 >> shift) & 1) | ((p1 >> shift) & 1) << 1];
+            for (int k=0; k<3; k++)
+                memset(line[k] + x * cap->scale, color[k], cap->scale);
+        }
+        for (int k=0; k<3; k++)
+            for (int s=1; s<cap->scale; s++)
+                memcpy(line[k] + (size_t) s * w, line[k], w);
+    }
+
+    if (fwrite("FRAME\n", 6, 1, cap->video) != 1) return -1;
+    return fwrite(cap->picture, plane_size * 3, 1, cap->video) == 1 ? 0 : -1;
+}
+
+static int write_samples(struct capture *cap) {
+    float samples[CAPTURE_SAMPLES] = {0};
+    if (cap->shown.sound)
+        sound_fill(&cap->tone, cap->shown.pattern_loaded ? cap->shown.pattern : NULL, cap->shown.pitch, samples, CAPTURE_SAMPLES);
+
+    uint8_t pcm[CAPTURE_SAMPLES * 2];
+    for (int i=0; i<CAPTURE_SAMPLES; i++)
+        put16(pcm + i * 2, (uint16_t) (int16_t) (samples[i] * 32767.0f));
+    cap->samples += CAPTURE_SAMPLES;
+    return fwrite(pcm, sizeof(pcm), 1, cap->audio) == 1 ? 0 : -1;
+}
+
+static void emit(struct capture *cap) {
+    // once a write fails keep draining, so the emulator never waits on us
+    if (!cap->failed && (write_picture(cap) != 0 || write_samples(cap) != 0))
+        cap->failed = 1;
+    cap->written++;
+}
+
+static void take(struct capture *cap, const struct capture_frame *f) {
+    // stand in for the frames the emulator had to drop
+    while (cap->written < f->number)
+        emit(cap);
+
+    for (int p=0; p<CHIP_8_PLANES; p++) {
+        for (uint64_t dirty = f->dirty[p]; dirty; dirty &= dirty - 1) {
+            int y = __builtin_ctzll(dirty);
+            cap->planes[p][y] = f->rows[p][y];
+        }
+    }
+    cap->shown.hires = f->hires;
+    cap->shown.sound = f->sound;
+    cap->shown.pattern_loaded = f->pattern_loaded;
+    cap->shown.pitch = f->pitch;
+    memcpy(cap->shown.pattern, f->pattern, sizeof(f->pattern));
+    emit(cap);
+}
+
+static void *capture_main(void *arg) {
+    struct capture *cap = arg;
+    for (;;) {
+        sem_wait(&cap->ready);
+
+        uint64_t tail = atomic_load_explicit(&cap->tail, memory_order_relaxed);
+        uint64_t head = atomic_load_explicit(&cap->head, memory_order_acquire);
+        for (; tail != head; tail++) {
+            take(cap, &cap->slots[tail & (CAPTURE_SLOTS - 1)]);
+            atomic_store(&cap->tail, tail + 1);
+            if (atomic_exchange(&cap->waiting, 0))
+                sem_post(&cap->space);
+        }
+
+        // the last frame is sent before closing is set, so one more look finds it
+        if (atomic_load_explicit(&cap->closing, memory_order_acquire)
+                && tail == atomic_load_explicit(&cap->head, memory_order_acquire))
+            break;
+    }
+    return NULL;
+}
+
+static FILE *open_output(const char *base, const char *ext) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%s", base, ext);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        printf("ERROR: Capture file %s could not be opened.\n", path);
+        return NULL;
+    }
+    setvbuf(f, NULL, _IOFBF, CAPTURE_BUFFER);
+    return f;
+}
+
+int capture_open(struct capture *cap, const char *base, int scale, const uint32_t *palette, int realtime) {
+    memset(cap, 0, sizeof(*cap));
+    cap->scale = scale < 1 ? 1 : scale;
+    cap->realtime = realtime;
+    palette_to_yuv(palette, cap->yuv);
+
+    cap->picture = malloc((size_t) CAPTURE_WIDTH(cap) * CAPTURE_HEIGHT(cap) * 3);
+    if (!cap->picture) {
+        printf("ERROR: Failed to allocate capture buffer.\n");
+        return -1;
+    }
+
+    cap->video = open_output(base, ".y4m");
+    cap->audio = cap->video ? open_output(base, ".wav") : NULL;
+    if (!cap->audio) {
+        if (cap->video) fclose(cap->video);
+        free(cap->picture);
+        return -1;
+    }
+
+    // sizes are patched in on close when the file can seek, a fifo keeps the streaming ones
+    if (fprintf(cap->video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", CAPTURE_WIDTH(cap), CAPTURE_HEIGHT(cap), SDL_FPS) < 0
+            || write_wav_header(cap->audio, CAPTURE_STREAMING) != 0) {
+        printf("ERROR: Capture files %s could not be written.\n", base);
+        fclose(cap->video);
+        fclose(cap->audio);
+        free(cap->picture);
+        return -1;
+    }
+
+    sem_init(&cap->ready, 0, 0);
+    sem_init(&cap->space, 0, 0);
+    if (pthread_create(&cap->thread, NULL, capture_main, cap) != 0) {
+        printf("ERROR: Failed to start capture thread.\n");
+        sem_destroy(&cap->ready);
+        sem_destroy(&cap->space);
+        fclose(cap->video);
+        fclose(cap->audio);
+        free(cap->picture);
+        return -1;
+    }
+    return 0;
+}
+
+void capture_frame(struct capture *cap, const struct chip *c) {
+    // runs on the emulation thread and never touches a file
+    uint64_t number = cap->frames++;
+    uint64_t head = atomic_load_explicit(&cap->head, memory_order_relaxed);
+    while (head - atomic_load(&cap->tail) == CAPTURE_SLOTS) {
+        if (cap->realtime) {
+            cap->dropped++;
+            return;
+        }
+        // say we are waiting before looking again, so the writer can't miss us
+        atomic_store(&cap->waiting, 1);
+        if (head - atomic_load(&cap->tail) == CAPTURE_SLOTS)
+            sem_wait(&cap->space);
+    }
+
+    struct capture_frame *f = &cap->slots[head & (CAPTURE_SLOTS - 1)];
+    f->number = number;
+    for (int p=0; p<CHIP_8_PLANES; p++) {
+        uint64_t dirty = 0;
+        for (int y=0; y<CHIP_8_HIRES_HEIGHT; y++) {
+            if (c->planes[p][y] != cap->sent[p][y]) {
+                f->rows[p][y] = cap->sent[p][y] = c->planes[p][y];
+                dirty |= 1ull << y;
+            }
+        }
+        f->dirty[p] = dirty;
+    }
+    f->hires = c->hires;
+    f->sound = c->sound_timer > 0;
+    f->pattern_loaded = c->pattern_loaded;
+    f->pitch = c->pitch;
+    memcpy(f->pattern, c->pattern, sizeof(f->pattern));
+
+    atomic_store_explicit(&cap->head, head + 1, memory_order_release);
+    sem_post(&cap->ready);
+}
+
+void capture_close(struct capture *cap) {
+    atomic_store_explicit(&cap->closing, 1, memory_order_release);
+    sem_post(&cap->ready);
+    pthread_join(cap->thread, NULL);
+    sem_destroy(&cap->ready);
+    sem_destroy(&cap->space);
+
+    // frames dropped at the very end have no later frame to fill them in
+    while (cap->written < cap->frames)
+        emit(cap);
+
+    // the whole file is known now
+    uint64_t data_size = cap->samples * 2;
+    if (!cap->failed && data_size < CAPTURE_STREAMING - 36 && fseek(cap->audio, 0, SEEK_SET) == 0)
+        if (write_wav_header(cap->audio, data_size) != 0) cap->failed = 1;
+
+    int closed = fclose(cap->video) == 0;
+    closed = fclose(cap->audio) == 0 && closed;
+    free(cap->picture);
+
+    if (cap->failed || !closed)
+        printf("ERROR: Capture could not be written in full.\n");
+    if (cap->dropped)
+        printf("Capture fell behind and repeated %llu of %llu frames.\n",
+                (unsigned long long) cap->dropped, (unsigned long long) cap->frames);
+}
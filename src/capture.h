@@ -0,0 +1,72 @@
+#ifndef CAPTURE
+#define CAPTURE
+
+#include "chip.h"
+#include "sound.h"
+#include "macros.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+
+#define CAPTURE_SLOTS               64      /* frames in flight to the writer, a power of two */
+#define CAPTURE_SAMPLES             (SOUND_SAMPLE_RATE / SDL_FPS)   /* audio samples per frame */
+#define CAPTURE_BUFFER              (1 << 20)   /* stdio buffer for each output file */
+
+/* one emulated frame on its way to the writer */
+struct capture_frame {
+    uint64_t number;                                /* frames captured before this one */
+    uint64_t dirty[CHIP_8_PLANES];                  /* rows changed since the last frame sent, bit y is row y */
+    chip_row rows[CHIP_8_PLANES][CHIP_8_HIRES_HEIGHT];  /* only the dirty rows are filled in */
+    uint8_t hires;
+    uint8_t sound;                                  /* sound timer was running */
+    uint8_t pattern_loaded;
+    uint8_t pitch;
+    uint8_t pattern[CHIP_8_AUDIO_PATTERN];
+};
+
+/*
+ * records every emulated frame to <base>.y4m and <base>.wav.
+ * the emulation thread only copies the rows that changed into a single
+ * producer single consumer ring, and a writer thread scales, converts and
+ * writes them. when the writer falls a whole ring behind, a realtime capture
+ * drops frames instead of stalling emulation, and the writer repeats the
+ * last frame it has in their place so the video and audio keep their length.
+ * otherwise the emulator sleeps until a slot frees up.
+ */
+struct capture {
+    struct capture_frame slots[CAPTURE_SLOTS];
+    _Atomic uint64_t head;                          /* next slot the emulator fills */
+    _Atomic uint64_t tail;                          /* next slot the writer takes */
+    _Atomic int closing;
+    _Atomic int waiting;                            /* emulator is asleep on space */
+    sem_t ready;                                    /* posted for every frame sent */
+    sem_t space;                                    /* posted when the emulator waits and a slot frees */
+    pthread_t thread;
+
+    // emulation thread
+    chip_row sent[CHIP_8_PLANES][CHIP_8_HIRES_HEIGHT];  /* display as of the last frame sent */
+    int realtime;                                   /* drop frames rather than wait for the writer */
+    uint64_t frames;
+    uint64_t dropped;
+
+    // writer thread
+    FILE *video;
+    FILE *audio;
+    int scale;
+    uint8_t yuv[PALETTE_COLORS][3];
+    uint8_t *picture;                               /* one Y, Cb and Cr plane at full size */
+    struct capture_frame shown;                     /* display and sound of the last frame written */
+    chip_row planes[CHIP_8_PLANES][CHIP_8_HIRES_HEIGHT];
+    struct sound tone;
+    uint64_t written;
+    uint64_t samples;
+    int failed;
+};
+
+int capture_open(struct capture *cap, const char *base, int scale, const uint32_t *palette, int realtime);
+void capture_frame(struct capture *cap, const struct chip *c);
+void capture_close(struct capture *cap);
+
+#endif
@@ -1,4 +1,5 @@
 #include "macros.h"
+#include "chip.h"
 #include "chip_return.h"
 
 #include <stdlib.h>
@@ -6,21 +7,11 @@
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
-#define STACK_MAX 16
-#define REGISTERS 16
-
-const size_t RAM = 4096;            /* number of bytes in 4kb. size of RAM */
-uint8_t *ram_ptr;                   /* pointer to our emulated RAM */
-uint8_t *pc;                        /* our program counter */
-uint8_t *font_ptr;                  /* points to font location in ram */
-uint16_t idx = 0;                   /* the index register */
-uint16_t stack[STACK_MAX];          /* array for stack */
-int stack_top = -1;                 /* index of current position in stack */
-uint8_t registers[REGISTERS] = {0}; /* array holding our registers */
-uint8_t delay_timer = 0;            /* delay timer; decrements at 60hz. */
-uint8_t sound_timer = 0;            /* sound timer */
-uint8_t font[80] = {                /* standard chip-8 font */
+const uint8_t font[80] = {                /* standard chip-8 font */
     0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
     0x20, 0x60, 0x20, 0x20, 0x70, // 1
     0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
@@ -38,45 +29,123 @@ uint8_t font[80] = {                /* standard chip-8 font */
     0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
-uint8_t pixels[CHIP_8_WIDTH][CHIP_8_HEIGHT] = {0};
-int keys[16] = {0};
-int key_wait = 0;
-int key_wait_filled = 1;
-uint8_t *key_register;
-
-int stack_push(uint16_t in) {
-    if (stack_top >= STACK_MAX) {
-        printf("ERROR: Cannot push. Stack is full.\n");
-        return -1;
-    }
 
-    stack[++stack_top]=in;
-    return 0;
+const uint8_t big_font[160] = {           /* super-chip 8x10 font, with xo-chip's A-F */
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+/*
+ * the stack is a ring. pushing onto a full stack overwrites the oldest return
+ * address and popping an empty one returns a stale one, instead of walking off
+ * the end of the array. a rom that does either was broken anyway.
+ */
+void stack_push(struct chip *c, uint16_t in) {
+    c->stack_top = (c->stack_top + 1) & CHIP_8_STACK_MASK;
+    c->stack[c->stack_top] = in;
 }
 
-uint16_t stack_pop() {
-    if (stack_top < 0) {
-        printf("ERROR: Cannot pop. Stack is empty.\n");
-        return -1;
-    }
+uint16_t stack_pop(struct chip *c) {
+    uint16_t out = c->stack[c->stack_top & CHIP_8_STACK_MASK];
+    c->stack_top = (c->stack_top - 1) & CHIP_8_STACK_MASK;
+    return out;
+}
 
-    return(stack[stack_top--]);
+uint8_t chip_rand(struct chip *c) {
+    // xorshift32. each machine carries its own state so runs are reproducible from a seed
+    uint32_t x = c->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    c->rng = x;
+    return x >> 24;
 }
 
-size_t filesize(FILE* f) {
-    fseek(f, 0L, SEEK_END);
-    size_t s = ftell(f);
-    fseek(f, 0L, SEEK_SET);
-    return s;
+int chip_width(const struct chip *c) {
+    return c->hires ? CHIP_8_HIRES_WIDTH : CHIP_8_WIDTH;
 }
 
-int chip_clean() {
-    free(ram_ptr);
+int chip_height(const struct chip *c) {
+    return c->hires ? CHIP_8_HIRES_HEIGHT : CHIP_8_HEIGHT;
+}
 
-    return 0;
+int chip_skip_width(const struct chip *c, uint16_t addr) {
+    // a skip over F000 NNNN has to clear all four bytes of it
+    return c->ram[addr & CHIP_8_RAM_MASK] == 0xF0 && c->ram[(addr + 1) & CHIP_8_RAM_MASK] == 0x00 ? 4 : 2;
+}
+
+/*
+ * the display is two planes of packed rows, so clearing, scrolling and
+ * drawing are a few word operations per row instead of one per pixel.
+ * only the planes selected with FN01 are touched.
+ */
+static chip_row screen_mask(const struct chip *c) {
+    // the columns in use. lores leaves the low half of every row empty
+    return c->hires ? ~(chip_row) 0 : (chip_row) ~0ULL << 64;
 }
 
-int decode(uint16_t op) {
+static void clear_planes(struct chip *c, int planes) {
+    for (int p = 0; p < CHIP_8_PLANES; p++)
+        if (planes & (1 << p))
+            memset(c->planes[p], 0, sizeof(c->planes[p]));
+}
+
+static void scroll_vertical(struct chip *c, int n) {
+    // n rows down, or up if negative
+    int h = chip_height(c);
+    int shift = n < 0 ? -n : n;
+    if (shift > h) shift = h;
+    for (int p = 0; p < CHIP_8_PLANES; p++) {
+        if (!(c->plane & (1 << p))) continue;
+        chip_row *rows = c->planes[p];
+        if (n > 0) {
+            memmove(rows + shift, rows, (h - shift) * sizeof(chip_row));
+            memset(rows, 0, shift * sizeof(chip_row));
+        } else {
+            memmove(rows, rows + shift, (h - shift) * sizeof(chip_row));
+            memset(rows + h - shift, 0, shift * sizeof(chip_row));
+        }
+    }
+}
+
+static void scroll_horizontal(struct chip *c, int n) {
+    // n pixels right, or left if negative
+    int h = chip_height(c);
+    chip_row mask = screen_mask(c);
+    for (int p = 0; p < CHIP_8_PLANES; p++) {
+        if (!(c->plane & (1 << p))) continue;
+        chip_row *rows = c->planes[p];
+        for (int y = 0; y < h; y++)
+            rows[y] = (n > 0 ? rows[y] >> n : rows[y] << -n) & mask;
+    }
+}
+
+static chip_row sprite_row(const struct chip *c, uint32_t bits, int width, int x) {
+    // one row of sprite at column x as a row of the display, wrapped around the right edge
+    if (c->hires) {
+        chip_row r = (chip_row) bits << (CHIP_8_HIRES_WIDTH - width);
+        return x ? r >> x | r << (CHIP_8_HIRES_WIDTH - x) : r;
+    }
+    uint64_t r = (uint64_t) bits << (CHIP_8_WIDTH - width);
+    if (x) r = r >> x | r << (CHIP_8_WIDTH - x);
+    return (chip_row) r << 64;
+}
+
+int decode(struct chip *c, uint16_t op) {
     // get each individual op
     uint8_t ops[4];
     ops[0] = (op & 0xF000) >> 12;
@@ -86,30 +155,78 @@ int decode(uint16_t op) {
 
     switch(ops[0]) {
         case 0x0:
+            if (ops[1] != 0) {
+                // 0NNN
+                // execute machine language subroutine at address NNN
+                // not needed unless directly emulating COSMAC VIP, ETI-660, or DREAM 6800
+                return -1;
+            }
             switch(ops[2]) {
+                case 0xC:
+                    // 00CN
+                    // scroll the display down N rows
+                    scroll_vertical(c, ops[3]);
+                    return 1;
+
+                case 0xD:
+                    // 00DN
+                    // scroll the display up N rows
+                    scroll_vertical(c, -ops[3]);
+                    return 1;
+
                 case 0xE:
                     switch(ops[3]) {
                         case 0x0:
                             // 00E0
                             // clear the screen
-                            memset(pixels, 0, sizeof(pixels));
+                            clear_planes(c, c->plane);
                             break;
                         case 0xE:
                             // 00EE
                             // return from a subroutine
-                            pc = ram_ptr + stack_pop();
+                            c->pc = stack_pop(c);
                             break;
                         default:
                             return -1;
                     }
                     break;
 
+                case 0xF:
+                    switch(ops[3]) {
+                        case 0xB:
+                            // 00FB
+                            // scroll the display right 4 pixels
+                            scroll_horizontal(c, 4);
+                            return 1;
+
+                        case 0xC:
+                            // 00FC
+                            // scroll the display left 4 pixels
+                            scroll_horizontal(c, -4);
+                            return 1;
+
+                        case 0xD:
+                            // 00FD
+                            // exit the interpreter. we stay on this instruction
+                            c->halted = 1;
+                            c->pc -= 2;
+                            break;
+
+                        case 0xE:
+                        case 0xF:
+                            // 00FE, 00FF
+                            // switch to lores or hires, clearing the display
+                            c->hires = ops[3] == 0xF;
+                            clear_planes(c, (1 << CHIP_8_PLANES) - 1);
+                            return 1;
+
+                        default:
+                            return -1;
+                    }
+                    break;
+
                 default:
-                    // 0NNN
-                    // execute machine language subroutine at address NNN
-                    // not needed unless directly emulating COSMAC VIP, ETI-660, or DREAM 6800
                     return -1;
-                    break;
             }
             break;
 
@@ -117,16 +234,16 @@ int decode(uint16_t op) {
             // 1NNN
             // jump to address NNN
             uint16_t offset = op & 0x0FFF;
-            pc = ram_ptr + offset;
+            c->pc = offset;
             break;
         }
             
         case 0x2: {
             // 2NNN
             // execute subroutine startign at address NNN
-            stack_push((uint16_t)(pc-ram_ptr));
+            stack_push(c, c->pc);
             uint16_t addr = op & 0x0FFF;
-            pc = ram_ptr + addr;
+            c->pc = addr;
             break;
         }
 
@@ -134,7 +251,7 @@ int decode(uint16_t op) {
             // 3XNN
             // skip the following instruction if the value of VX equals NN
             uint8_t nn = op & 0x00FF;
-            if (registers[ops[1]] == nn) pc+=2;
+            if (c->registers[ops[1]] == nn) c->pc += chip_skip_width(c, c->pc);
             break;
         }
 
@@ -142,22 +259,46 @@ int decode(uint16_t op) {
             // 4XNN
             // skip the following instruction if the value of VX is nnont equal to NN
             uint8_t nn = op & 0x00FF;
-            if (registers[ops[1]] != nn) pc += 2;
+            if (c->registers[ops[1]] != nn) c->pc += chip_skip_width(c, c->pc);
             break;
         }
 
-        case 0x5: {
-            // 5XY0
-            // skip the following instructionn if the value of VX is equal to the value of VY
-            if (registers[ops[1]] == registers[ops[2]]) pc += 2;
+        case 0x5:
+            switch(ops[3]) {
+                case 0x0:
+                    // 5XY0
+                    // skip the following instructionn if the value of VX is equal to the value of VY
+                    if (c->registers[ops[1]] == c->registers[ops[2]]) c->pc += chip_skip_width(c, c->pc);
+                    break;
+
+                case 0x2:
+                case 0x3: {
+                    // 5XY2, 5XY3
+                    // store VX-VY inclusive in memory starting at index, or load them from it
+                    // X may be above Y, in which case the registers go in reverse. index is unchanged
+                    int dir = ops[1] <= ops[2] ? 1 : -1;
+                    int n = (ops[2] - ops[1]) * dir;
+                    for (int i=0; i<=n; i++) {
+                        uint8_t *r = &c->registers[ops[1] + i*dir];
+                        uint8_t *m = &c->ram[(c->idx + i) & CHIP_8_RAM_MASK];
+                        if (ops[3] == 0x2) *m = *r;
+                        else *r = *m;
+                    }
+                    if (ops[3] == 0x2) chip_ram_written(c, c->idx, n + 1);
+                    break;
+                }
+
+                default:
+                    // illegal instruction
+                    return -1;
+            }
             break;
-        }
 
         case 0x6: {
             // 6XNN
             // store NN in VX
             uint8_t nn = op & 0x00FF;
-            registers[ops[1]] = nn;
+            c->registers[ops[1]] = nn;
             break;
         }
 
@@ -165,7 +306,7 @@ int decode(uint16_t op) {
             // 7XNN
             // add NN to VX
             uint8_t nn = op & 0x00FF;
-            registers[ops[1]] += nn;
+            c->registers[ops[1]] += nn;
             break;
         }
 
@@ -174,25 +315,28 @@ int decode(uint16_t op) {
                 case 0x0:
                     // 8XY0
                     // store the value of VY in VX
-                    registers[ops[1]] = registers[ops[2]];
+                    c->registers[ops[1]] = c->registers[ops[2]];
                     break;
                 
                 case 0x1:
                     // 8XY1
                     // set VX to VX OR VY
-                    registers[ops[1]] = registers[ops[1]] | registers[ops[2]];
+                    c->registers[ops[1]] = c->registers[ops[1]] | c->registers[ops[2]];
+                    if (c->quirks & CHIP_QUIRK_VF_RESET) c->registers[0xF] = 0;
                     break;
 
                 case 0x2:
                     // 8XY2
                     // set VX to VX AND VY
-                    registers[ops[1]] = registers[ops[1]] & registers[ops[2]];
+                    c->registers[ops[1]] = c->registers[ops[1]] & c->registers[ops[2]];
+                    if (c->quirks & CHIP_QUIRK_VF_RESET) c->registers[0xF] = 0;
                     break;
 
                 case 0x3:
                     // 8XY3
                     // set VX to VX XOR VY
-                    registers[ops[1]] = registers[ops[1]] ^ registers[ops[2]];
+                    c->registers[ops[1]] = c->registers[ops[1]] ^ c->registers[ops[2]];
+                    if (c->quirks & CHIP_QUIRK_VF_RESET) c->registers[0xF] = 0;
                     break;
 
                 case 0x4: {
@@ -200,11 +344,11 @@ int decode(uint16_t op) {
                     // add the value of VY to VX
                     // set VF to 01 if a carry occurs
                     // set VF to 00 if no carry occurs
-                    uint8_t tmp_vx = registers[ops[1]];
-                    registers[ops[1]] += registers[ops[2]];
+                    uint8_t tmp_vx = c->registers[ops[1]];
+                    c->registers[ops[1]] += c->registers[ops[2]];
 
-                    if (registers[ops[1]] < tmp_vx) registers[0xF] = 1;
-                    else registers[0xF] = 0;
+                    if (c->registers[ops[1]] < tmp_vx) c->registers[0xF] = 1;
+                    else c->registers[0xF] = 0;
                     break; 
                 }
 
@@ -213,11 +357,11 @@ int decode(uint16_t op) {
                     // subtract the value of VY from VX
                     // set VF to 00 if a borrow occurs
                     // set VF to 01 if no borrow occurs
-                    uint8_t tmp_vx = registers[ops[1]];
-                    registers[ops[1]] -= registers[ops[2]];
+                    uint8_t tmp_vx = c->registers[ops[1]];
+                    c->registers[ops[1]] -= c->registers[ops[2]];
 
-                    if (registers[ops[1]] < tmp_vx) registers[0xF] = 1;
-                    else registers[0xf] = 0;
+                    if (c->registers[ops[1]] < tmp_vx) c->registers[0xF] = 1;
+                    else c->registers[0xf] = 0;
                     break;
                 }
 
@@ -226,9 +370,11 @@ int decode(uint16_t op) {
                     // store the value of VY shifted right one bit in VX
                     // set VF to the least significant bit prior to the shift
                     // VY is unchanged
-                    uint8_t lsb  = registers[ops[2]] & 0x1;
-                    registers[ops[1]] = registers[ops[2]] >> 1;
-                    registers[0xF] =  lsb;
+                    // with CHIP_QUIRK_SHIFT, VX is shifted in place
+                    uint8_t src = c->registers[(c->quirks & CHIP_QUIRK_SHIFT) ? ops[1] : ops[2]];
+                    uint8_t lsb  = src & 0x1;
+                    c->registers[ops[1]] = src >> 1;
+                    c->registers[0xF] =  lsb;
                     break;
                 }
 
@@ -237,10 +383,10 @@ int decode(uint16_t op) {
                     // set VX to the value of VY minux VX
                     // set VF to 00 if a borrow occurs
                     // set VF to 01 if a no borrow occurs
-                    registers[ops[1]] =  registers[ops[2]] - registers[ops[1]];
+                    c->registers[ops[1]] =  c->registers[ops[2]] - c->registers[ops[1]];
 
-                    if (registers[ops[1]] < registers[ops[2]]) registers[0xF] = 1;
-                    else registers[0xF] = 0;
+                    if (c->registers[ops[1]] < c->registers[ops[2]]) c->registers[0xF] = 1;
+                    else c->registers[0xF] = 0;
                     break;
 
                 case 0xE: {
@@ -249,10 +395,12 @@ int decode(uint16_t op) {
                     // set VF to the most significant bit prior to the shift
                     // VY is unchanged
                     // 0b10000000 -> 0x80
-                    uint8_t msb = registers[ops[2]] & 0x80;
+                    // with CHIP_QUIRK_SHIFT, VX is shifted in place
+                    uint8_t src = c->registers[(c->quirks & CHIP_QUIRK_SHIFT) ? ops[1] : ops[2]];
+                    uint8_t msb = src & 0x80;
                     msb >>= 7;
-                    registers[ops[1]] = registers[ops[2]] << 1;
-                    registers[0xF] = msb;
+                    c->registers[ops[1]] = src << 1;
+                    c->registers[0xF] = msb;
                     break;
                 }
 
@@ -266,7 +414,7 @@ int decode(uint16_t op) {
                 case 0x0:
                     // 9XY0
                     // skip the folowing instruction if the value of VX is not equal to the value of VY
-                    if (registers[ops[1]] != registers[ops[2]]) pc+=2;
+                    if (c->registers[ops[1]] != c->registers[ops[2]]) c->pc += chip_skip_width(c, c->pc);
                     break;
 
                 default:
@@ -278,14 +426,16 @@ int decode(uint16_t op) {
         case 0xA:
             // ANNN
             // store memory address NNN in index
-            idx = op & 0x0FFF;
+            c->idx = op & 0x0FFF;
             break;
             
         case 0xB: {
             // BNNN
             // jump to address NNN + V0
+            // with CHIP_QUIRK_JUMP this is BXNN, jump to address XNN + VX
             uint16_t offset = op & 0x0FFF;
-            pc = ram_ptr + (registers[0] + offset);
+            uint8_t base = c->registers[(c->quirks & CHIP_QUIRK_JUMP) ? ops[1] : 0];
+            c->pc = (base + offset) & CHIP_8_RAM_MASK;
             break;
         }
 
@@ -293,34 +443,38 @@ int decode(uint16_t op) {
             // CXNN
             // set VX to a random number with a mask of NN
             uint8_t nn = op & 0x00FF;
-            registers[ops[1]] = nn & (rand()%256);
+            c->registers[ops[1]] = nn & (chip_rand(c) % 256);
             break;
         }
 
         case 0xD: {
             // DXYN
             // draw a sprite at position VX, VY with N bytes of sprite data starting at the address stored in index
+            // DXY0 draws a 16x16 sprite, two bytes per row
+            // with both planes selected, the second plane's sprite follows the first's
             // set VF to 01 if any pixels are changed to unset, 00 otherwise
-            int vx = registers[ops[1]];
-            int vy = registers[ops[2]];
-
-            registers[0xF] = 0;
-
-            for(int i=0; i<ops[3]; i++) {
-                uint8_t sprite = *(ram_ptr + idx + i);
-                int y = (vy+i) % CHIP_8_HEIGHT;
-                if (y > CHIP_8_HEIGHT) break;
-                for(int j=0; j<8; j++) {
-                    int x = (vx+j) % CHIP_8_WIDTH;
-
-                    uint8_t pixel = (sprite >> (7-j)) & 0x1;
-                    if (pixel == 0) continue;
-
-                    if (x > CHIP_8_WIDTH) break;
-
-                    if (pixels[x][y] == 1)
-                        registers[0xF] = 1;
-                    pixels[x][y] ^= pixel;
+            int w = chip_width(c);
+            int h = chip_height(c);
+            int x = c->registers[ops[1]] % w;
+            int y = c->registers[ops[2]] % h;
+            int bytes = ops[3] ? 1 : 2;
+            int rows = ops[3] ? ops[3] : 16;
+            uint16_t addr = c->idx;
+
+            c->registers[0xF] = 0;
+
+            for (int p=0; p<CHIP_8_PLANES; p++) {
+                if (!(c->plane & (1 << p))) continue;
+                for (int i=0; i<rows; i++) {
+                    uint32_t bits = c->ram[addr & CHIP_8_RAM_MASK];
+                    if (bytes == 2) bits = bits << 8 | c->ram[(addr + 1) & CHIP_8_RAM_MASK];
+                    addr += bytes;
+
+                    chip_row sprite = sprite_row(c, bits, bytes * 8, x);
+                    chip_row *row = &c->planes[p][(y + i) % h];
+                    if (*row & sprite)
+                        c->registers[0xF] = 1;
+                    *row ^= sprite;
                 }
             }
             // break;
@@ -332,13 +486,13 @@ int decode(uint16_t op) {
                 case 0x9:
                     // EX9E
                     // skip the following instruction if the key corresponding to the hex value curretly stored in VX is pressed
-                    if (keys[registers[ops[1]]]) pc += 2;
+                    if (c->keys[c->registers[ops[1]] & 0xF]) c->pc += chip_skip_width(c, c->pc);
                     break;
 
                 case 0xA:
                     // EXA1
                     // skip the followig instruction if the key corresponding to the hex value currently stored in VX is not pressed
-                    if (!keys[registers[ops[1]]]) pc += 2;
+                    if (!c->keys[c->registers[ops[1]] & 0xF]) c->pc += chip_skip_width(c, c->pc);
                     break;
 
                 default:
@@ -351,34 +505,57 @@ int decode(uint16_t op) {
             switch(ops[2]) {
                 case 0x0:
                     switch(ops[3]) {
+                        case 0x0:
+                            // F000 NNNN
+                            // store the 16 bit address in the following two bytes in index
+                            if (ops[1] != 0) return -1;
+                            c->idx = (c->ram[c->pc & CHIP_8_RAM_MASK] << 8) | c->ram[(c->pc + 1) & CHIP_8_RAM_MASK];
+                            c->pc += 2;
+                            break;
+
+                        case 0x1:
+                            // FN01
+                            // select the planes N that draws, clears and scrolls act on
+                            c->plane = ops[1] & ((1 << CHIP_8_PLANES) - 1);
+                            break;
+
+                        case 0x2:
+                            // F002
+                            // load the audio pattern from the 16 bytes starting at index
+                            if (ops[1] != 0) return -1;
+                            for (int i=0; i<CHIP_8_AUDIO_PATTERN; i++)
+                                c->pattern[i] = c->ram[(c->idx + i) & CHIP_8_RAM_MASK];
+                            c->pattern_loaded = 1;
+                            break;
+
                         case 0x7:
                             // FX07
                             // store the current value of the delay timer in VX
-                            registers[ops[1]] = delay_timer;
+                            c->registers[ops[1]] = c->delay_timer;
                             break;
 
                         case 0xA:
                             // FX0A
                             // wait for a keypress and store the result in VX
-                            if (key_wait && !key_wait_filled) {
+                            if (c->key_wait && !c->key_wait_filled) {
                                 /*
                                  * should already have this state:
                                  * key_wait = 1;
                                  * key_wait_filled = 0;
-                                 * key_register = &registers[ops[1]];
+                                 * key_register = ops[1];
                                  */
-                                pc -= 2;
-                            } else if (key_wait && key_wait_filled) {
+                                c->pc -= 2;
+                            } else if (c->key_wait && c->key_wait_filled) {
                                 // key was pressed, register was filled
-                                key_wait = 0;
-                                key_wait_filled = 1;
-                                key_register = NULL;
+                                c->key_wait = 0;
+                                c->key_wait_filled = 1;
+                                c->key_register = 0;
                             } else {
                                 // initialize key wait
-                                key_wait = 1;
-                                key_wait_filled = 0;
-                                key_register = &registers[ops[1]];
-                                pc -= 2;
+                                c->key_wait = 1;
+                                c->key_wait_filled = 0;
+                                c->key_register = ops[1];
+                                c->pc -= 2;
                             }
                             break;
 
@@ -393,21 +570,21 @@ int decode(uint16_t op) {
                         case 0x5:
                             // FX15
                             // set the delay timer to the value of VX
-                            delay_timer = registers[ops[1]];
+                            c->delay_timer = c->registers[ops[1]];
                             break;
                         
                         case 0x8:
                             // FX18
                             // set the sound timer t the value of register VX
-                            sound_timer = registers[ops[1]];
+                            c->sound_timer = c->registers[ops[1]];
                             break;
 
                         case 0xE: {
                             // FX1E
                             // add the value stred in VX to index
-                            uint16_t idx_tmp = idx;
-                            idx += registers[ops[1]];
-                            if (idx_tmp > idx) registers[0xF] = 1;
+                            uint16_t idx_tmp = c->idx;
+                            c->idx += c->registers[ops[1]];
+                            if (idx_tmp > c->idx) c->registers[0xF] = 1;
                             break;
                         }
 
@@ -422,7 +599,7 @@ int decode(uint16_t op) {
                         case 0x9:
                             // FX29
                             // set index to the memory address of the sprite data corresponding to the hexademical digit stored in VX
-                            idx = (font_ptr + registers[ops[1]]*5) - ram_ptr;
+                            c->idx = CHIP_8_FONT_START + c->registers[ops[1]]*5;
                             break;
 
                         default:
@@ -433,14 +610,27 @@ int decode(uint16_t op) {
 
                 case 0x3:
                     switch(ops[3]) {
+                        case 0x0:
+                            // FX30
+                            // set index to the big font sprite for the hexadecimal digit stored in VX
+                            c->idx = CHIP_8_BIG_FONT_START + (c->registers[ops[1]] & 0xF)*10;
+                            break;
+
+                        case 0xA:
+                            // FX3A
+                            // set the audio pattern's playback pitch to VX
+                            c->pitch = c->registers[ops[1]];
+                            break;
+
                         case 0x3: {
                             // FX33
                             // store the binary-coded decimal equivalent of the value stored in VX at addresses idnex, idex+1, index+2
-                            int val = registers[ops[1]];
+                            int val = c->registers[ops[1]];
                             for (int i=2; i>=0; i--) {
-                                *(ram_ptr + idx + i) = val % 10;
+                                c->ram[(c->idx + i) & CHIP_8_RAM_MASK] = val % 10;
                                 val /= 10;
                             }
+                            chip_ram_written(c, c->idx, 3);
                             break;
                         }
 
@@ -455,9 +645,11 @@ int decode(uint16_t op) {
                         case 0x5: {
                             // FX55
                             // store the values of V0-VX inclusive in memory starting at index
-                            // index is set to idnex + X + 1 after operation
+                            // index is set to index + X + 1 after operation
                             for (int i=0; i<=ops[1]; i++)
-                                *(ram_ptr + idx + i) = registers[i];
+                                c->ram[(c->idx + i) & CHIP_8_RAM_MASK] = c->registers[i];
+                            chip_ram_written(c, c->idx, ops[1] + 1);
+                            if (!(c->quirks & CHIP_QUIRK_MEMORY)) c->idx += ops[1] + 1;
                             break;
                         }
 
@@ -473,14 +665,31 @@ int decode(uint16_t op) {
                             // FX65
                             // fill registers V0-VX inclusive with the values stored in memory starting at index
                             // index is set to index + x + 1 after operation
+                            for (int i=0; i<=ops[1]; i++)
+                                c->registers[i] = c->ram[(c->idx + i) & CHIP_8_RAM_MASK];
+                            if (!(c->quirks & CHIP_QUIRK_MEMORY)) c->idx += ops[1] + 1;
+                            break;
+
+                        default:
+                            // illegal instructio
+                            return -1;
+                    }
+                    break;
+
+                case 0x7:
+                case 0x8:
+                    switch(ops[3]) {
+                        case 0x5:
+                            // FX75, FX85
+                            // save V0-VX inclusive to the flag registers, or load them back
                             for (int i=0; i<=ops[1]; i++) {
-                                registers[i] = *(ram_ptr + idx);
-                                idx++;
+                                if (ops[2] == 0x7) c->flags[i] = c->registers[i];
+                                else c->registers[i] = c->flags[i];
                             }
                             break;
 
                         default:
-                            // illegal instructio
+                            // illegal instruction
                             return -1;
                     }
                     break;
@@ -498,65 +707,124 @@ int decode(uint16_t op) {
     return 0;
 }
 
-uint16_t fetch() {
-    uint16_t op = (pc[0] << 8) | pc[1];
+uint16_t fetch(struct chip *c) {
+    uint16_t op = (c->ram[c->pc & CHIP_8_RAM_MASK] << 8) | c->ram[(c->pc + 1) & CHIP_8_RAM_MASK];
 
-    pc += 2;
+    c->pc += 2;
     return op;
 }
 
-int decrement_timers() {
-    if (delay_timer > 0) delay_timer --;
-    if (sound_timer > 0) sound_timer --;
+int decrement_timers(struct chip *c) {
+    if (c->delay_timer > 0) c->delay_timer --;
+    if (c->sound_timer > 0) c->sound_timer --;
     return 0;
 }
 
-struct chip_return chip_cycle() {
+struct chip_return chip_cycle(struct chip *c) {
     struct chip_return status = {0};
 
-    uint16_t op = fetch();
+    uint16_t op = fetch(c);
 
-    status.decode_status = decode(op);
+    status.decode_status = decode(c, op);
     if(status.decode_status < 0) {
-        printf("ERROR: Failed to decode instruction: %x\n", op);
-        struct chip_return fail = {-1, -1};
+        // the caller reports it, so threads running side by side don't interleave
+        struct chip_return fail = {-1, -1, op};
         return fail;
     }
 
-    status.sound_status = sound_timer;
+    status.sound_status = c->sound_timer;
 
     return status;
 }
 
-int chip_init(char* filename) {
-    ram_ptr = malloc(RAM);
-    if (!ram_ptr) {
-        printf("ERROR: Failed to allocate RAM.\n");
-        return -1;
+void chip_key(struct chip *c, int key, int down) {
+    c->keys[key] = down;
+    if (down && !c->key_wait_filled) {
+        c->registers[c->key_register] = (uint8_t) key;
+        c->key_wait_filled = 1;
     }
+}
+
+void chip_reset(struct chip *c, uint32_t seed) {
+    memset(c, 0, sizeof(*c));
+    c->pc = CHIP_8_PROGRAM_START;
+    c->stack_top = -1;
+    c->key_wait_filled = 1;
+    // xorshift never leaves 0
+    c->rng = seed ? seed : 1;
+
+    c->plane = 1;
+    c->pitch = CHIP_8_AUDIO_PITCH;
+    c->ram_top = CHIP_8_RAM_PAGE;
+
+    // load the fonts
+    memcpy(c->ram + CHIP_8_FONT_START, font, sizeof(font));
+    memcpy(c->ram + CHIP_8_BIG_FONT_START, big_font, sizeof(big_font));
+}
+
+int chip_load(struct chip *c, const uint8_t *rom, size_t size) {
+    if (size > CHIP_8_ROM_MAX) return CHIP_ERROR_SIZE;
 
-    pc = ram_ptr + 0x200;
-    font_ptr = ram_ptr + 0x50;
+    memcpy(c->ram + CHIP_8_PROGRAM_START, rom, size);
+    c->rom_size = size;
+    chip_ram_written(c, CHIP_8_PROGRAM_START, size);
+    return 0;
+}
+
+void chip_ram_written(struct chip *c, uint32_t addr, uint32_t len) {
+    // a write that wraps past the end lands below ram_top, so clamping is enough
+    uint32_t end = addr + len < CHIP_8_RAM ? addr + len : CHIP_8_RAM;
+    if (end > c->ram_top)
+        c->ram_top = (end + CHIP_8_RAM_PAGE - 1) & ~(CHIP_8_RAM_PAGE - 1);
+}
+
+void chip_copy(struct chip *dst, const struct chip *src) {
+    // both sides are zero past their ram_top, so only ram below the higher one moves
+    if (dst == src) return;
+    uint32_t old_top = dst->ram_top;
+    memcpy(dst->ram, src->ram, src->ram_top);
+    if (old_top > src->ram_top)
+        memset(dst->ram + src->ram_top, 0, old_top - src->ram_top);
+
+    size_t rest = offsetof(struct chip, ram) + sizeof(src->ram);
+    memcpy((uint8_t *) dst + rest, (const uint8_t *) src + rest, sizeof(*src) - rest);
+}
 
-    // load the font
-    memcpy(font_ptr, font, sizeof(font));
+int chip_init(struct chip *c, char* filename, uint32_t seed) {
+    // nothing is printed here. batch workers load roms side by side, so the caller reports
+    chip_reset(c, seed);
 
     // load the rom
-    FILE *f = fopen(filename, "rb");
-    if (!f) {
-        printf("ERROR: File %s could not be loaded.\n", filename);
-        return -1;
-    }
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return CHIP_ERROR_OPEN;
 
-    size_t size = filesize(f);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return CHIP_ERROR_OPEN;
+    }
 
-    size_t read = fread(pc, 1, size, f);
-    if (read != size) {
-        printf("ERROR: Failed to copy file to RAM.\n");
+    if (st.st_size > CHIP_8_ROM_MAX) {
+        close(fd);
+        return CHIP_ERROR_SIZE;
     }
 
-    // unload file
-    fclose(f);
+    // straight into RAM, one syscall
+    ssize_t got = pread(fd, c->ram + CHIP_8_PROGRAM_START, st.st_size, 0);
+    close(fd);
+    if (got != st.st_size) return CHIP_ERROR_READ;
 
+    c->rom_size = got;
+    chip_ram_written(c, CHIP_8_PROGRAM_START, got);
     return 0;
 }
+
+const char *chip_error(int status) {
+    // what went wrong in chip_init or chip_load, to follow the rom's name
+    switch (status) {
+        case CHIP_ERROR_OPEN: return "could not be loaded";
+        case CHIP_ERROR_READ: return "could not be copied to RAM";
+        case CHIP_ERROR_SIZE: return "is larger than the RAM above 0x200";
+    }
+    return "failed to load";
+}
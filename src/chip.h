@@ -2,16 +2,68 @@
 #define CHIP
 
 #include "macros.h"
+#include "chip_return.h"
+#include <stddef.h>
 #include <stdint.h>
 
-extern uint8_t pixels[CHIP_8_WIDTH][CHIP_8_HEIGHT];
-extern int keys[16];
-extern int key_wait_filled;
-extern uint8_t *key_register;
+/* chip_init and chip_load return 0 or one of these. they print nothing, see chip_error() */
+#define CHIP_ERROR_OPEN             -1      /* missing, unreadable or not a regular file */
+#define CHIP_ERROR_READ             -2      /* came up short */
+#define CHIP_ERROR_SIZE             -3      /* larger than CHIP_8_ROM_MAX */
 
-int decrement_timers();
-struct chip_return chip_cycle();
-int chip_init(char* file);
-int chip_clean();
+/*
+ * one row of a bitplane, leftmost pixel in the top bit. lores uses the top
+ * 64 bits of the first 32 rows, hires all of them.
+ */
+typedef unsigned __int128 chip_row;
+
+#define CHIP_ROW_BIT(x)             ((chip_row) 1 << (CHIP_8_HIRES_WIDTH - 1 - (x)))
+
+/*
+ * the complete state of one chip-8 machine.
+ * nothing in here points back into itself, so a machine can be copied
+ * with a plain assignment and any number of them can run side by side.
+ * most roms never leave the first 4kb of ram, so chip_copy() and anything
+ * that hashes a machine only look below ram_top.
+ */
+struct chip {
+    uint8_t ram[CHIP_8_RAM];                        /* emulated RAM */
+    uint16_t pc;                                    /* our program counter, as an offset into ram */
+    uint16_t idx;                                   /* the index register */
+    uint16_t stack[CHIP_8_STACK_MAX];               /* array for stack */
+    int stack_top;                                  /* index of current position in stack */
+    uint8_t registers[CHIP_8_REGISTERS];            /* array holding our registers */
+    uint8_t delay_timer;                            /* delay timer; decrements at 60hz. */
+    uint8_t sound_timer;                            /* sound timer */
+    chip_row planes[CHIP_8_PLANES][CHIP_8_HIRES_HEIGHT];   /* the display, one bit per pixel per plane */
+    uint8_t hires;                                  /* 128x64 instead of 64x32 */
+    uint8_t plane;                                  /* planes drawn to, one bit each */
+    uint8_t halted;                                 /* ran 00FD */
+    int keys[CHIP_8_KEYS];
+    int key_wait;
+    int key_wait_filled;
+    uint8_t key_register;                           /* register FX0A stores the next key in */
+    uint8_t flags[CHIP_8_FLAGS];                    /* FX75/FX85 storage */
+    uint8_t pattern[CHIP_8_AUDIO_PATTERN];          /* xo-chip audio samples */
+    uint8_t pitch;                                  /* FX3A playback rate */
+    uint8_t pattern_loaded;                         /* F002 has run, play pattern instead of a tone */
+    uint32_t rng;                                   /* xorshift state for CXNN */
+    uint32_t quirks;                                /* CHIP_QUIRK_* flags */
+    uint16_t rom_size;                              /* bytes loaded at 0x200, at most CHIP_8_ROM_MAX */
+    uint32_t ram_top;                               /* ram from here up is all zero. only grows */
+};
+
+int chip_width(const struct chip *c);
+int chip_height(const struct chip *c);
+int chip_skip_width(const struct chip *c, uint16_t addr);
+int decrement_timers(struct chip *c);
+struct chip_return chip_cycle(struct chip *c);
+void chip_key(struct chip *c, int key, int down);
+void chip_reset(struct chip *c, uint32_t seed);
+int chip_load(struct chip *c, const uint8_t *rom, size_t size);
+void chip_ram_written(struct chip *c, uint32_t addr, uint32_t len);
+void chip_copy(struct chip *dst, const struct chip *src);
+int chip_init(struct chip *c, char* file, uint32_t seed);
+const char *chip_error(int status);
 
 #endif
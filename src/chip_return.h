@@ -4,6 +4,7 @@
 struct chip_return {
     int decode_status;
     int sound_status;
+    int opcode;     /* the instruction that failed, when decode_status < 0 */
 };
 
 #endif
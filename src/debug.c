@@ -0,0 +1,626 @@
+#include "debug.h"
+#include "chip.h"
+#include "chip_return.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+/*
+ * protocol: one command per line, answered by any number of data lines and
+ * then a line starting with OK or ERROR. numbers are hex.
+ *   info                       what is running, and whether it is stopped
+ *   pause                      stop at the next block
+ *   wait                       block until stopped. answers STOPPED <reason> <pc> <addr>
+ *   continue
+ *   step [n]                   run n instructions, then stop
+ *   break <addr>               delete <addr>
+ *   watch <addr> [len]         unwatch <addr> [len]
+ *   regs
+ *   set <v0-vf|pc|i|dt|st> <value>
+ *   read <addr> <len>
+ *   write <addr> <bytes>       bytes as one hex string, e.g. 00e0
+ *   disasm <addr> [count]
+ * everything but info, pause and wait needs the machine stopped.
+ * when the client disconnects its breakpoints and watchpoints are dropped
+ * and the machine runs on.
+ */
+
+static const char *debug_reason_names[] = {"pause", "break", "watch", "step"};
+
+static uint16_t read_op(const struct chip *c, uint16_t addr) {
+    return (c->ram[addr & CHIP_8_RAM_MASK] << 8) | c->ram[(addr + 1) & CHIP_8_RAM_MASK];
+}
+
+static int map_test(const uint64_t *map, uint32_t lo, uint32_t hi) {
+    // any bit set in [lo, hi). a word at a time
+    if (lo >= hi) return 0;
+    uint32_t first = lo / 64;
+    uint32_t last = (hi - 1) / 64;
+    for (uint32_t w = first; w <= last; w++) {
+        uint64_t m = ~0ULL;
+        if (w == first) m &= ~0ULL << (lo % 64);
+        if (w == last) m &= ~0ULL >> (63 - (hi - 1) % 64);
+        if (map[w] & m) return 1;
+    }
+    return 0;
+}
+
+static int map_range(const uint64_t *map, uint16_t addr, int len) {
+    // [addr, addr + len), wrapping around the end of RAM like the core does
+    uint32_t end = (uint32_t) addr + len;
+    if (end <= CHIP_8_RAM) return map_test(map, addr, end);
+    return map_test(map, addr, CHIP_8_RAM) || map_test(map, 0, end - CHIP_8_RAM);
+}
+
+static int map_set(uint64_t *map, uint16_t addr, int len, int on) {
+    // returns how many bits changed
+    int changed = 0;
+    for (int i = 0; i < len; i++) {
+        uint16_t a = (addr + i) & CHIP_8_RAM_MASK;
+        uint64_t bit = 1ULL << (a % 64);
+        if (((map[a / 64] & bit) != 0) != on) {
+            map[a / 64] ^= bit;
+            changed++;
+        }
+    }
+    return changed;
+}
+
+static int mem_access(const struct chip *c, uint16_t op, int *len) {
+    // the bytes an instruction reads or writes, starting at index
+    int x = (op & 0x0F00) >> 8;
+    int y = (op & 0x00F0) >> 4;
+    switch (op >> 12) {
+        case 0x5:
+            // 5XY2, 5XY3
+            if ((op & 0xF) != 0x2 && (op & 0xF) != 0x3) return 0;
+            *len = (x > y ? x - y : y - x) + 1;
+            return 1;
+        case 0xD: {
+            // DXYN, once per selected plane
+            int n = op & 0xF;
+            *len = (n ? n : 32) * __builtin_popcount(c->plane & ((1 << CHIP_8_PLANES) - 1));
+            return *len > 0;
+        }
+        case 0xF:
+            switch (op & 0xFF) {
+                case 0x02: *len = CHIP_8_AUDIO_PATTERN; return x == 0;
+                case 0x33: *len = 3; return 1;
+                case 0x55:
+                case 0x65: *len = x + 1; return 1;
+            }
+            return 0;
+    }
+    return 0;
+}
+
+static int ends_block(uint16_t op) {
+    // anything that can send pc somewhere other than the next instruction
+    switch (op >> 12) {
+        case 0x0: return op == 0x00EE || op == 0x00FD;
+        case 0x1: case 0x2: case 0x3: case 0x4: case 0x5: case 0x9: case 0xB: case 0xE:
+            return 1;
+        case 0xF: return (op & 0xFF) == 0x0A;
+    }
+    return 0;
+}
+
+static void rearm(struct debug *d) {
+    d->armed = d->break_count || d->watch_count || d->step;
+}
+
+static void detach(struct debug *d) {
+    memset(d->breaks, 0, sizeof(d->breaks));
+    memset(d->watches, 0, sizeof(d->watches));
+    d->break_count = 0;
+    d->watch_count = 0;
+    d->step = 0;
+    rearm(d);
+}
+
+static void debug_stop(struct debug *d, struct chip *c, enum debug_reason reason, uint16_t addr) {
+    // park the machine until the client lets it go
+    pthread_mutex_lock(&d->lock);
+    if (d->client_fd >= 0 && !d->closing) {
+        d->machine = c;
+        d->reason = reason;
+        d->reason_addr = addr;
+        d->stopped = 1;
+        pthread_cond_broadcast(&d->cond);
+        uint16_t pc = c->pc;
+        while (d->stopped && !d->closing)
+            pthread_cond_wait(&d->cond, &d->lock);
+        // resume only skips the checks on the instruction we stopped at
+        if (c->pc != pc) d->resume = 0;
+        d->machine = NULL;
+    }
+    pthread_mutex_unlock(&d->lock);
+}
+
+static void run_one(struct chip *c, struct chip_return *status) {
+    // an illegal instruction doesn't end the frame, the rest of its cycles
+    // still run. the first failure is what the frame reports
+    struct chip_return r = chip_cycle(c);
+    if (status->decode_status < 0) return;
+    if (r.decode_status < 0) {
+        *status = r;
+        return;
+    }
+    if (r.decode_status) status->decode_status = r.decode_status;
+    if (r.sound_status) status->sound_status = r.sound_status;
+}
+
+static int run_block(struct debug *d, struct chip *c, int max, struct chip_return *status) {
+    // the straight-line run from pc up to the next jump, call, return or skip
+    uint16_t start = c->pc;
+    uint16_t end = c->pc;
+    uint16_t ops[DEBUG_BLOCK_MAX];
+    int n = 0;
+    int mem = 0;
+    while (n < max && n < DEBUG_BLOCK_MAX) {
+        uint16_t op = read_op(c, end);
+        int len;
+        ops[n++] = op;
+        end += op == 0xF000 ? 4 : 2;
+        // the plane can change inside the block, so any draw counts
+        if ((op >> 12) == 0xD || mem_access(c, op, &len)) mem = 1;
+        if (ends_block(op)) break;
+    }
+
+    // one check for the whole block. usually nothing is in it
+    if (!d->step && !(mem && d->watch_count) && !map_range(d->breaks, c->pc, (uint16_t) (end - c->pc))) {
+        // FX55, FX33 and 5XY2 can rewrite the block as it runs. the check
+        // only holds for the instructions we scanned, so stop at the first
+        // one that moved or changed and let the caller scan again from there
+        uint16_t at = start;
+        for (int i = 0; i < n; i++) {
+            if (c->pc != at || read_op(c, at) != ops[i]) {
+                d->resume = 0;
+                return i;
+            }
+            at += ops[i] == 0xF000 ? 4 : 2;
+            run_one(c, status);
+        }
+        d->resume = 0;
+        return n;
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (!d->resume) {
+            uint16_t op = read_op(c, c->pc);
+            int len;
+            if (map_range(d->breaks, c->pc, 1)) {
+                debug_stop(d, c, DEBUG_BREAK, c->pc);
+                // the client may have moved pc or rewritten the block
+                return i;
+            }
+            if (d->watch_count && mem_access(c, op, &len) && map_range(d->watches, c->idx, len)) {
+                uint16_t addr = c->idx;
+                while (!map_range(d->watches, addr, 1)) addr++;
+                debug_stop(d, c, DEBUG_WATCH, addr);
+                return i;
+            }
+        }
+        d->resume = 0;
+
+        run_one(c, status);
+        if (d->step && --d->step == 0) {
+            debug_stop(d, c, DEBUG_STEP, c->pc);
+            return i + 1;
+        }
+    }
+    return n;
+}
+
+struct chip_return chip_run(struct chip *c, int cycles, struct debug *d) {
+    struct chip_return status = {0};
+    int i = 0;
+    while (i < cycles) {
+        if (d && atomic_load_explicit(&d->request, memory_order_relaxed)) {
+            int request = atomic_exchange(&d->request, 0);
+            if (request & DEBUG_REQUEST_DETACH) detach(d);
+            if (request & DEBUG_REQUEST_PAUSE) debug_stop(d, c, DEBUG_PAUSE, c->pc);
+        }
+
+        if (!d || !d->armed) {
+            // nothing can stop us, run the rest flat out
+            for (; i < cycles; i++)
+                run_one(c, &status);
+            if (d) d->resume = 0;
+            break;
+        }
+
+        i += run_block(d, c, cycles - i, &status);
+    }
+    return status;
+}
+
+int chip_disasm(const struct chip *c, uint16_t addr, char *buf, size_t size) {
+    // writes one instruction in the usual mnemonics, returns its length in bytes
+    uint16_t op = read_op(c, addr);
+    int x = (op & 0x0F00) >> 8;
+    int y = (op & 0x00F0) >> 4;
+    int n = op & 0x000F;
+    int nn = op & 0x00FF;
+    int nnn = op & 0x0FFF;
+    static const char *alu[16] = {
+        "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+        NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL,
+    };
+
+    switch (op >> 12) {
+        case 0x0:
+            if (op == 0x00E0) return snprintf(buf, size, "CLS"), 2;
+            if (op == 0x00EE) return snprintf(buf, size, "RET"), 2;
+            if (op == 0x00FB) return snprintf(buf, size, "SCR"), 2;
+            if (op == 0x00FC) return snprintf(buf, size, "SCL"), 2;
+            if (op == 0x00FD) return snprintf(buf, size, "EXIT"), 2;
+            if (op == 0x00FE) return snprintf(buf, size, "LOW"), 2;
+            if (op == 0x00FF) return snprintf(buf, size, "HIGH"), 2;
+            if ((op & 0xFFF0) == 0x00C0) return snprintf(buf, size, "SCD %X", n), 2;
+            if ((op & 0xFFF0) == 0x00D0) return snprintf(buf, size, "SCU %X", n), 2;
+            return snprintf(buf, size, "SYS %03X", nnn), 2;
+        case 0x1: return snprintf(buf, size, "JP %03X", nnn), 2;
+        case 0x2: return snprintf(buf, size, "CALL %03X", nnn), 2;
+        case 0x3: return snprintf(buf, size, "SE V%X, %02X", x, nn), 2;
+        case 0x4: return snprintf(buf, size, "SNE V%X, %02X", x, nn), 2;
+        case 0x5:
+            if (n == 0x0) return snprintf(buf, size, "SE V%X, V%X", x, y), 2;
+            if (n == 0x2) return snprintf(buf, size, "SAVE V%X-V%X", x, y), 2;
+            if (n == 0x3) return snprintf(buf, size, "LOAD V%X-V%X", x, y), 2;
+            break;
+        case 0x6: return snprintf(buf, size, "LD V%X, %02X", x, nn), 2;
+        case 0x7: return snprintf(buf, size, "ADD V%X, %02X", x, nn), 2;
+        case 0x8:
+            if (alu[n]) return snprintf(buf, size, "%s V%X, V%X", alu[n], x, y), 2;
+            break;
+        case 0x9:
+            if (n == 0x0) return snprintf(buf, size, "SNE V%X, V%X", x, y), 2;
+            break;
+        case 0xA: return snprintf(buf, size, "LD I, %03X", nnn), 2;
+        case 0xB: return snprintf(buf, size, "JP V0, %03X", nnn), 2;
+        case 0xC: return snprintf(buf, size, "RND V%X, %02X", x, nn), 2;
+        case 0xD: return snprintf(buf, size, "DRW V%X, V%X, %X", x, y, n), 2;
+        case 0xE:
+            if (nn == 0x9E) return snprintf(buf, size, "SKP V%X", x), 2;
+            if (nn == 0xA1) return snprintf(buf, size, "SKNP V%X", x), 2;
+            break;
+        case 0xF:
+            switch (nn) {
+                case 0x00:
+                    if (x == 0) return snprintf(buf, size, "LD I, %04X", read_op(c, addr + 2)), 4;
+                    break;
+                case 0x01: return snprintf(buf, size, "PLANE %X", x), 2;
+                case 0x02:
+                    if (x == 0) return snprintf(buf, size, "AUDIO"), 2;
+                    break;
+                case 0x07: return snprintf(buf, size, "LD V%X, DT", x), 2;
+                case 0x0A: return snprintf(buf, size, "LD V%X, K", x), 2;
+                case 0x15: return snprintf(buf, size, "LD DT, V%X", x), 2;
+                case 0x18: return snprintf(buf, size, "LD ST, V%X", x), 2;
+                case 0x1E: return snprintf(buf, size, "ADD I, V%X", x), 2;
+                case 0x29: return snprintf(buf, size, "LD F, V%X", x), 2;
+                case 0x30: return snprintf(buf, size, "LD HF, V%X", x), 2;
+                case 0x33: return snprintf(buf, size, "LD B, V%X", x), 2;
+                case 0x3A: return snprintf(buf, size, "PITCH V%X", x), 2;
+                case 0x55: return snprintf(buf, size, "LD [I], V%X", x), 2;
+                case 0x65: return snprintf(buf, size, "LD V%X, [I]", x), 2;
+                case 0x75: return snprintf(buf, size, "LD R, V%X", x), 2;
+                case 0x85: return snprintf(buf, size, "LD V%X, R", x), 2;
+            }
+            break;
+    }
+    return snprintf(buf, size, "DW %04X", op), 2;
+}
+
+static void reply(struct debug *d, const char *fmt, ...) {
+    // queued, not sent. a client that stops reading must never block
+    // someone holding the lock, and the machine takes it to stop
+    char line[DEBUG_LINE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line) - 1, fmt, args);
+    va_end(args);
+    if (n < 0) return;
+    if ((size_t) n > sizeof(line) - 2) n = sizeof(line) - 2;
+    line[n++] = '\n';
+    if (d->out_len + n > sizeof(d->out)) return;
+    memcpy(d->out + d->out_len, line, n);
+    d->out_len += n;
+}
+
+static void flush(struct debug *d) {
+    // only ever called without the lock. a client that went away shows up
+    // as EOF on the next read
+    if (d->out_len) send(d->client_fd, d->out, d->out_len, MSG_NOSIGNAL);
+    d->out_len = 0;
+}
+
+static int parse_hex(const char *s, unsigned long max, unsigned long *out) {
+    if (!s) return -1;
+    char *end;
+    errno = 0;
+    unsigned long v = strtoul(s, &end, 16);
+    if (errno || end == s || *end || v > max) return -1;
+    *out = v;
+    return 0;
+}
+
+static uint8_t *reg_ptr(struct chip *c, const char *name) {
+    // the 8 bit registers by name
+    if ((name[0] == 'v' || name[0] == 'V') && name[1] && !name[2]) {
+        unsigned long r;
+        if (parse_hex(name + 1, CHIP_8_REGISTERS - 1, &r) == 0) return &c->registers[r];
+    }
+    if (strcmp(name, "dt") == 0) return &c->delay_timer;
+    if (strcmp(name, "st") == 0) return &c->sound_timer;
+    return NULL;
+}
+
+static void stopped_command(struct debug *d, char *cmd, char *a1, char *a2) {
+    // only called with the machine parked in debug_stop()
+    struct chip *c = d->machine;
+    unsigned long addr, v;
+
+    if (strcmp(cmd, "continue") == 0 || strcmp(cmd, "step") == 0) {
+        d->step = 0;
+        if (cmd[0] == 's') {
+            v = 1;
+            if (a1 && (parse_hex(a1, 0xFFFFFF, &v) != 0 || v == 0)) {
+                reply(d, "ERROR bad count");
+                return;
+            }
+            d->step = v;
+        }
+        rearm(d);
+        d->resume = 1;
+        d->stopped = 0;
+        pthread_cond_broadcast(&d->cond);
+        reply(d, "OK");
+    } else if (strcmp(cmd, "break") == 0 || strcmp(cmd, "delete") == 0) {
+        if (parse_hex(a1, CHIP_8_RAM_MASK, &addr) != 0) {
+            reply(d, "ERROR bad address");
+            return;
+        }
+        int on = cmd[0] == 'b';
+        d->break_count += map_set(d->breaks, addr, 1, on) * (on ? 1 : -1);
+        rearm(d);
+        reply(d, "OK");
+    } else if (strcmp(cmd, "watch") == 0 || strcmp(cmd, "unwatch") == 0) {
+        unsigned long len = 1;
+        if (parse_hex(a1, CHIP_8_RAM_MASK, &addr) != 0) {
+            reply(d, "ERROR bad address");
+            return;
+        }
+        if (a2 && (parse_hex(a2, CHIP_8_RAM, &len) != 0 || len == 0)) {
+            reply(d, "ERROR bad length");
+            return;
+        }
+        int on = cmd[0] == 'w';
+        d->watch_count += map_set(d->watches, addr, len, on) * (on ? 1 : -1);
+        rearm(d);
+        reply(d, "OK");
+    } else if (strcmp(cmd, "regs") == 0) {
+        char line[DEBUG_LINE_MAX];
+        int n = snprintf(line, sizeof(line), "pc=%04X i=%04X sp=%X dt=%02X st=%02X plane=%X hires=%d",
+                c->pc, c->idx, c->stack_top & CHIP_8_STACK_MASK, c->delay_timer, c->sound_timer, c->plane, c->hires);
+        for (int r = 0; r < CHIP_8_REGISTERS; r++)
+            n += snprintf(line + n, sizeof(line) - n, " v%x=%02X", r, c->registers[r]);
+        reply(d, "%s", line);
+        reply(d, "OK");
+    } else if (strcmp(cmd, "set") == 0) {
+        if (!a1 || parse_hex(a2, 0xFFFF, &v) != 0) {
+            reply(d, "ERROR usage: set <register> <value>");
+            return;
+        }
+        uint8_t *r = reg_ptr(c, a1);
+        if (strcmp(a1, "pc") == 0) c->pc = v;
+        else if (strcmp(a1, "i") == 0) c->idx = v;
+        else if (r && v <= 0xFF) *r = v;
+        else {
+            reply(d, "ERROR bad register or value");
+            return;
+        }
+        reply(d, "OK");
+    } else if (strcmp(cmd, "read") == 0) {
+        if (parse_hex(a1, CHIP_8_RAM_MASK, &addr) != 0 || parse_hex(a2, DEBUG_READ_MAX, &v) != 0) {
+            reply(d, "ERROR usage: read <addr> <len>, at most %X bytes", DEBUG_READ_MAX);
+            return;
+        }
+        char line[DEBUG_READ_MAX * 3 + 1] = "";
+        for (unsigned long i = 0; i < v; i++)
+            snprintf(line + i * 3, 4, "%02X ", c->ram[(addr + i) & CHIP_8_RAM_MASK]);
+        if (v) line[v * 3 - 1] = '\0';
+        reply(d, "%s", line);
+        reply(d, "OK");
+    } else if (strcmp(cmd, "write") == 0) {
+        size_t len = a2 ? strlen(a2) : 0;
+        if (parse_hex(a1, CHIP_8_RAM_MASK, &addr) != 0 || len == 0 || len % 2) {
+            reply(d, "ERROR usage: write <addr> <hex bytes>");
+            return;
+        }
+        for (size_t i = 0; i < len; i += 2) {
+            char byte[3] = {a2[i], a2[i + 1], '\0'};
+            if (parse_hex(byte, 0xFF, &v) != 0) {
+                reply(d, "ERROR bad byte %s", byte);
+                return;
+            }
+            c->ram[(addr + i / 2) & CHIP_8_RAM_MASK] = v;
+            chip_ram_written(c, (addr + i / 2) & CHIP_8_RAM_MASK, 1);
+        }
+        reply(d, "OK");
+    } else if (strcmp(cmd, "disasm") == 0) {
+        unsigned long count = 8;
+        if (parse_hex(a1, CHIP_8_RAM_MASK, &addr) != 0) {
+            reply(d, "ERROR bad address");
+            return;
+        }
+        if (a2 && parse_hex(a2, DEBUG_BLOCK_MAX, &count) != 0) {
+            reply(d, "ERROR bad count");
+            return;
+        }
+        for (unsigned long i = 0; i < count; i++) {
+            char text[64];
+            int len = chip_disasm(c, addr, text, sizeof(text));
+            reply(d, "%04lX  %04X  %s%s", addr, read_op(c, addr), text, map_range(d->breaks, addr, 1) ? "  *" : "");
+            addr = (addr + len) & CHIP_8_RAM_MASK;
+        }
+        reply(d, "OK");
+    } else {
+        reply(d, "ERROR unknown command %s", cmd);
+    }
+}
+
+static void command(struct debug *d, char *line) {
+    char *save;
+    char *cmd = strtok_r(line, " \t\r", &save);
+    if (!cmd) return;
+    char *a1 = strtok_r(NULL, " \t\r", &save);
+    char *a2 = strtok_r(NULL, " \t\r", &save);
+
+    pthread_mutex_lock(&d->lock);
+    if (strcmp(cmd, "info") == 0) {
+        reply(d, "%s %s", d->name ? d->name : "-", d->stopped ? "stopped" : "running");
+        reply(d, "OK");
+    } else if (strcmp(cmd, "pause") == 0) {
+        if (!d->stopped) atomic_fetch_or(&d->request, DEBUG_REQUEST_PAUSE);
+        reply(d, "OK");
+    } else if (strcmp(cmd, "wait") == 0) {
+        while (!d->stopped && !d->closing)
+            pthread_cond_wait(&d->cond, &d->lock);
+        if (d->stopped)
+            reply(d, "STOPPED %s %04X %04X", debug_reason_names[d->reason], d->machine->pc, d->reason_addr);
+        else
+            reply(d, "ERROR closing");
+    } else if (!d->stopped) {
+        reply(d, "ERROR running, pause first");
+    } else {
+        stopped_command(d, cmd, a1, a2);
+    }
+    pthread_mutex_unlock(&d->lock);
+    flush(d);
+}
+
+static void *debug_main(void *arg) {
+    struct debug *d = arg;
+    char buf[DEBUG_LINE_MAX];
+
+    for (;;) {
+        int fd = accept(d->listen_fd, NULL, NULL);
+        pthread_mutex_lock(&d->lock);
+        if (d->closing || (fd < 0 && errno != EINTR)) {
+            pthread_mutex_unlock(&d->lock);
+            if (fd >= 0) close(fd);
+            break;
+        }
+        d->client_fd = fd;
+        pthread_mutex_unlock(&d->lock);
+        if (fd < 0) continue;
+
+        size_t used = 0;
+        ssize_t got;
+        while ((got = recv(fd, buf + used, sizeof(buf) - used, 0)) > 0) {
+            used += got;
+            char *start = buf;
+            char *nl;
+            while ((nl = memchr(start, '\n', buf + used - start))) {
+                *nl = '\0';
+                command(d, start);
+                start = nl + 1;
+            }
+            used -= start - buf;
+            memmove(buf, start, used);
+            if (used == sizeof(buf)) {
+                reply(d, "ERROR line too long");
+                flush(d);
+                used = 0;
+            }
+        }
+
+        // the client is gone. let the machine go and forget what it set
+        pthread_mutex_lock(&d->lock);
+        if (d->stopped) {
+            detach(d);
+            d->stopped = 0;
+            d->resume = 1;
+            pthread_cond_broadcast(&d->cond);
+        } else {
+            atomic_fetch_or(&d->request, DEBUG_REQUEST_DETACH);
+        }
+        d->client_fd = -1;
+        pthread_mutex_unlock(&d->lock);
+        close(fd);
+    }
+    return NULL;
+}
+
+int debug_open(struct debug *d, const char *path) {
+    memset(d, 0, sizeof(*d));
+    d->listen_fd = -1;
+    d->client_fd = -1;
+
+    struct sockaddr_un addr = {0};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        printf("ERROR: Debugger socket path %s is too long.\n", path);
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    strcpy(d->path, path);
+
+    // a socket left behind by an earlier run. never anything else
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path);
+
+    d->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (d->listen_fd < 0 || bind(d->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0
+            || listen(d->listen_fd, 1) != 0) {
+        printf("ERROR: Debugger socket %s could not be opened.\n", path);
+        if (d->listen_fd >= 0) close(d->listen_fd);
+        return -1;
+    }
+
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->cond, NULL);
+    if (pthread_create(&d->thread, NULL, debug_main, d) != 0) {
+        printf("ERROR: Failed to start debugger thread.\n");
+        close(d->listen_fd);
+        unlink(d->path);
+        return -1;
+    }
+    return 0;
+}
+
+void debug_close(struct debug *d) {
+    pthread_mutex_lock(&d->lock);
+    d->closing = 1;
+    pthread_cond_broadcast(&d->cond);
+    // ends the client's read, but lets an answer to wait still go out
+    if (d->client_fd >= 0) shutdown(d->client_fd, SHUT_RD);
+    pthread_mutex_unlock(&d->lock);
+
+    // wakes the accept()
+    shutdown(d->listen_fd, SHUT_RDWR);
+    pthread_join(d->thread, NULL);
+    close(d->listen_fd);
+    unlink(d->path);
+    pthread_cond_destroy(&d->cond);
+    pthread_mutex_destroy(&d->lock);
+}
+
+void debug_attach(struct debug *d, const char *name) {
+    pthread_mutex_lock(&d->lock);
+    d->name = name;
+    pthread_mutex_unlock(&d->lock);
+}
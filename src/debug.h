@@ -0,0 +1,68 @@
+#ifndef DEBUGGER
+#define DEBUGGER
+
+#include "chip.h"
+#include "chip_return.h"
+#include "macros.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define DEBUG_MAP_WORDS             (CHIP_8_RAM / 64)   /* one bit per address */
+#define DEBUG_BLOCK_MAX             64      /* instructions scanned ahead for one block */
+#define DEBUG_LINE_MAX              1024    /* longest command line */
+#define DEBUG_READ_MAX              256     /* most bytes one read returns */
+#define DEBUG_REPLY_MAX             (DEBUG_BLOCK_MAX * 64 + DEBUG_LINE_MAX)    /* longest answer, a full disasm */
+#define DEBUG_REQUEST_PAUSE         0x1     /* client asked the machine to stop */
+#define DEBUG_REQUEST_DETACH        0x2     /* client left, drop its breakpoints */
+
+enum debug_reason {
+    DEBUG_PAUSE,
+    DEBUG_BREAK,
+    DEBUG_WATCH,
+    DEBUG_STEP,
+};
+
+/*
+ * a debugger attached to one machine, served over a unix domain socket.
+ * chip_run() only looks at it between blocks of straight-line code, and
+ * only goes instruction by instruction through a block that a breakpoint,
+ * watchpoint or step could stop in. with nothing set it costs two loads a
+ * frame. breakpoints and watchpoints are changed only while the machine is
+ * stopped, so the interpreter reads them without locking.
+ */
+struct debug {
+    uint64_t breaks[DEBUG_MAP_WORDS];               /* execute breakpoints */
+    uint64_t watches[DEBUG_MAP_WORDS];              /* read/write watchpoints */
+    int break_count;
+    int watch_count;
+    int armed;                                      /* something above is set, or stepping */
+    int step;                                       /* instructions left to step, 0 when running */
+    int resume;                                     /* run the next instruction even if it is a breakpoint */
+    _Atomic int request;                            /* DEBUG_REQUEST_*, handled between blocks */
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int stopped;
+    enum debug_reason reason;
+    uint16_t reason_addr;                           /* breakpoint or watched address that stopped us */
+    struct chip *machine;                           /* valid while stopped */
+    const char *name;                               /* what is running, for info */
+    int closing;
+
+    char path[108];
+    int listen_fd;
+    int client_fd;
+    char out[DEBUG_REPLY_MAX];                      /* answer to the current command, sent after unlocking */
+    size_t out_len;
+    pthread_t thread;
+};
+
+int debug_open(struct debug *d, const char *path);
+void debug_close(struct debug *d);
+void debug_attach(struct debug *d, const char *name);
+struct chip_return chip_run(struct chip *c, int cycles, struct debug *d);
+int chip_disasm(const struct chip *c, uint16_t addr, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,468 @@
+#include "explore.h"
+#include "chip.h"
+#include "hash.h"
+#include "lanes.h"
+#include "workers.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+/*
+ * searches the inputs of a rom for a path to a target state.
+ * every state is expanded by holding each of the 16 keys for a few frames.
+ * the 16 children of a state start out identical, so they are stepped
+ * together on a chip_lanes, two parents at a time. every child is hashed
+ * into a lock-free table and only new states are kept.
+ */
+
+#define EXPLORE_PARENTS     (CHIP_LANES / EXPLORE_KEYS)     /* parents expanded per lane batch */
+#define EXPLORE_ROOT        0
+
+struct explore_node {
+    int parent;
+    uint8_t key;
+    uint8_t depth;
+};
+
+struct explore_entry {
+    struct chip state;
+    int node;
+    int score;
+};
+
+struct explore_ctx {
+    struct explore_options opts;        /* the caller's, clamped to what we can do */
+    struct explore_result *result;
+
+    _Atomic uint64_t *table;            /* state hashes. 0 marks an empty slot */
+    uint64_t table_mask;
+
+    struct explore_node *nodes;         /* how every state was reached */
+    _Atomic int node_count;
+
+    _Atomic int found;                  /* node of the target, or -1 */
+    _Atomic int stop;
+    _Atomic long duplicates;
+    _Atomic long dropped;
+
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+
+    /* breadth-first: one level at a time, workers meet under lock between levels */
+    struct explore_entry *cur;
+    struct explore_entry *next;
+    int cur_count;
+    _Atomic int cur_taken;
+    _Atomic int next_count;
+    int depth;                          /* of the states in next */
+    int running;                        /* workers that meet at the end of a level */
+    int arrived;
+    int level;                          /* bumped as the last worker arrives */
+    int done;
+
+    /* best-first: a heap of slots in a fixed pool, under lock */
+    struct explore_entry *pool;
+    int *heap;
+    int heap_count;
+    int *free_slots;
+    int free_count;
+    int busy;
+};
+
+struct explore_worker {
+    struct explore_ctx *ctx;
+    struct chip_lanes *lanes;
+    struct explore_entry *children;     /* EXPLORE_PARENTS * EXPLORE_KEYS */
+    struct explore_entry *parents;      /* EXPLORE_PARENTS, best-first only */
+};
+
+int explore_pattern_match(const struct chip *c, void *pattern) {
+    struct explore_pattern *p = pattern;
+    for (int i = 0; i < CHIP_8_PLANES; i++)
+        for (int y = 0; y < CHIP_8_HIRES_HEIGHT; y++)
+            if ((c->planes[i][y] ^ p->planes[i][y]) & p->mask[i][y])
+                return 0;
+    return 1;
+}
+
+static uint64_t state_hash(const struct chip *c) {
+    // keys are always released between inputs, so they are left out
+    uint32_t misc[] = {
+        c->pc, c->idx, c->stack_top, c->delay_timer, c->sound_timer,
+        c->key_wait, c->key_wait_filled, c->key_register, c->rng,
+        c->hires, c->plane, c->halted, c->pitch, c->pattern_loaded,
+    };
+    // ram past ram_top is zero, so it adds nothing
+    uint64_t h = hash64(c->ram, c->ram_top, 0);
+    h = hash64(c->planes, sizeof(c->planes), h);
+    h = hash64(c->registers, sizeof(c->registers), h);
+    h = hash64(c->stack, sizeof(c->stack), h);
+    h = hash64(c->flags, sizeof(c->flags), h);
+    h = hash64(c->pattern, sizeof(c->pattern), h);
+    h = hash64(misc, sizeof(misc), h);
+    return h ? h : 1;
+}
+
+static void entry_copy(struct explore_entry *dst, const struct explore_entry *src) {
+    // a plain assignment would move all 64kb of ram
+    chip_copy(&dst->state, &src->state);
+    dst->node = src->node;
+    dst->score = src->score;
+}
+
+static int table_insert(struct explore_ctx *x, uint64_t h) {
+    // linear probing. returns 1 if h is new, 0 if we have seen it
+    for (uint64_t i = h & x->table_mask;; i = (i + 1) & x->table_mask) {
+        uint64_t slot = atomic_load_explicit(&x->table[i], memory_order_relaxed);
+        if (slot == h) return 0;
+        if (slot == 0) {
+            uint64_t empty = 0;
+            if (atomic_compare_exchange_strong(&x->table[i], &empty, h)) return 1;
+            if (empty == h) return 0;
+        }
+    }
+}
+
+static int expand(struct explore_worker *w, struct explore_entry **parents, int count) {
+    struct explore_ctx *x = w->ctx;
+    const struct explore_options *opts = &x->opts;
+    struct chip_lanes *l = w->lanes;
+
+    chip_lanes_reset(l);
+    for (int p = 0; p < count; p++) {
+        for (int key = 0; key < EXPLORE_KEYS; key++) {
+            int lane = p * EXPLORE_KEYS + key;
+            chip_lanes_set(l, lane, &parents[p]->state);
+            chip_lanes_key(l, lane, key, 1);
+        }
+    }
+
+    for (int f = 0; f < opts->frames_per_input && l->active; f++)
+        chip_lanes_frame(l, opts->cycles_per_frame);
+
+    int n = 0;
+    for (int lane = 0; lane < count * EXPLORE_KEYS; lane++) {
+        if (!((l->active >> lane) & 1)) continue;
+
+        struct explore_entry *parent = parents[lane / EXPLORE_KEYS];
+        struct explore_entry *child = &w->children[n];
+        int key = lane % EXPLORE_KEYS;
+        chip_lanes_get(l, lane, &child->state);
+        chip_key(&child->state, key, 0);
+
+        if (!table_insert(x, state_hash(&child->state))) {
+            atomic_fetch_add(&x->duplicates, 1);
+            continue;
+        }
+
+        int node = atomic_fetch_add(&x->node_count, 1);
+        if (node >= opts->max_states) {
+            atomic_store(&x->stop, 1);
+            break;
+        }
+        x->nodes[node].parent = parent->node;
+        x->nodes[node].key = key;
+        x->nodes[node].depth = x->nodes[parent->node].depth + 1;
+        child->node = node;
+
+        if (opts->target(&child->state, opts->target_user)) {
+            int none = -1;
+            if (atomic_compare_exchange_strong(&x->found, &none, node))
+                chip_copy(&x->result->state, &child->state);
+            atomic_store(&x->stop, 1);
+            break;
+        }
+
+        child->score = opts->score ? opts->score(&child->state, opts->score_user) : x->nodes[node].depth;
+        n++;
+    }
+
+    return n;
+}
+
+static int level_done(struct explore_ctx *x) {
+    // the barrier between levels. the last worker in swaps the frontiers
+    // and lets the rest go. returns 1 once the search is over
+    pthread_mutex_lock(&x->lock);
+    int level = x->level;
+    if (++x->arrived == x->running) {
+        int next = atomic_load(&x->next_count);
+        if (next > x->opts.max_frontier) next = x->opts.max_frontier;
+
+        struct explore_entry *tmp = x->cur;
+        x->cur = x->next;
+        x->next = tmp;
+        x->cur_count = next;
+        atomic_store(&x->cur_taken, 0);
+        atomic_store(&x->next_count, 0);
+
+        x->depth++;
+        x->done = x->depth > x->opts.max_depth || x->cur_count == 0 || atomic_load(&x->stop);
+        x->arrived = 0;
+        x->level++;
+        pthread_cond_broadcast(&x->wake);
+    } else {
+        while (x->level == level)
+            pthread_cond_wait(&x->wake, &x->lock);
+    }
+    int done = x->done;
+    pthread_mutex_unlock(&x->lock);
+    return done;
+}
+
+static void *bfs_worker(void *arg) {
+    struct explore_worker *w = arg;
+    struct explore_ctx *x = w->ctx;
+
+    do {
+        while (!atomic_load(&x->stop)) {
+            int i = atomic_fetch_add(&x->cur_taken, EXPLORE_PARENTS);
+            if (i >= x->cur_count) break;
+
+            struct explore_entry *parents[EXPLORE_PARENTS];
+            int count = 0;
+            for (; count < EXPLORE_PARENTS && i + count < x->cur_count; count++)
+                parents[count] = &x->cur[i + count];
+
+            int n = expand(w, parents, count);
+            for (int c = 0; c < n; c++) {
+                int slot = atomic_fetch_add(&x->next_count, 1);
+                if (slot >= x->opts.max_frontier) {
+                    atomic_fetch_add(&x->dropped, 1);
+                    continue;
+                }
+                entry_copy(&x->next[slot], &w->children[c]);
+            }
+        }
+    } while (!level_done(x));
+
+    return NULL;
+}
+
+static int heap_less(struct explore_ctx *x, int a, int b) {
+    struct explore_entry *ea = &x->pool[x->heap[a]];
+    struct explore_entry *eb = &x->pool[x->heap[b]];
+    if (ea->score != eb->score) return ea->score < eb->score;
+    return x->nodes[ea->node].depth < x->nodes[eb->node].depth;
+}
+
+static void heap_swap(struct explore_ctx *x, int a, int b) {
+    int tmp = x->heap[a];
+    x->heap[a] = x->heap[b];
+    x->heap[b] = tmp;
+}
+
+static void heap_push(struct explore_ctx *x, struct explore_entry *e) {
+    if (x->free_count == 0) {
+        atomic_fetch_add(&x->dropped, 1);
+        return;
+    }
+
+    int slot = x->free_slots[--x->free_count];
+    entry_copy(&x->pool[slot], e);
+
+    int i = x->heap_count++;
+    x->heap[i] = slot;
+    while (i > 0 && heap_less(x, i, (i - 1) / 2)) {
+        heap_swap(x, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static int heap_pop(struct explore_ctx *x) {
+    int slot = x->heap[0];
+    x->heap[0] = x->heap[--x->heap_count];
+
+    int i = 0;
+    for (;;) {
+        int l = 2 * i + 1;
+        int r = l + 1;
+        int best = i;
+        if (l < x->heap_count && heap_less(x, l, best)) best = l;
+        if (r < x->heap_count && heap_less(x, r, best)) best = r;
+        if (best == i) break;
+        heap_swap(x, i, best);
+        i = best;
+    }
+    return slot;
+}
+
+static void *best_first_worker(void *arg) {
+    struct explore_worker *w = arg;
+    struct explore_ctx *x = w->ctx;
+
+    pthread_mutex_lock(&x->lock);
+    for (;;) {
+        while (!atomic_load(&x->stop) && x->heap_count == 0 && x->busy > 0)
+            pthread_cond_wait(&x->wake, &x->lock);
+        if (atomic_load(&x->stop) || x->heap_count == 0) break;
+
+        // take the best states we can fit in one lane batch
+        struct explore_entry *parents[EXPLORE_PARENTS];
+        int count = 0;
+        while (count < EXPLORE_PARENTS && x->heap_count > 0) {
+            int slot = heap_pop(x);
+            if (x->nodes[x->pool[slot].node].depth < x->opts.max_depth) {
+                entry_copy(&w->parents[count], &x->pool[slot]);
+                parents[count] = &w->parents[count];
+                count++;
+            }
+            x->free_slots[x->free_count++] = slot;
+        }
+        if (count == 0) continue;
+
+        x->busy++;
+        pthread_mutex_unlock(&x->lock);
+
+        int n = expand(w, parents, count);
+
+        pthread_mutex_lock(&x->lock);
+        for (int c = 0; c < n; c++)
+            heap_push(x, &w->children[c]);
+        x->busy--;
+        pthread_cond_broadcast(&x->wake);
+    }
+
+    // let everyone else see the same exit condition
+    pthread_cond_broadcast(&x->wake);
+    pthread_mutex_unlock(&x->lock);
+    return NULL;
+}
+
+static void explore_breadth_first(struct explore_ctx *x, struct explore_worker *workers, int threads) {
+    if (x->opts.max_depth < 1) return;
+    x->depth = 1;
+
+    // the workers run every level. hold the lock until we know how many
+    // started, so none of them reaches the end of a level before that
+    struct workers running;
+    pthread_mutex_lock(&x->lock);
+    x->running = workers_start(&running, threads, bfs_worker, workers, sizeof(*workers));
+    pthread_mutex_unlock(&x->lock);
+    bfs_worker(&workers[0]);
+    workers_join(&running);
+}
+
+static void explore_best_first(struct explore_ctx *x, struct explore_worker *workers, int threads) {
+    for (int i = 0; i < x->opts.max_frontier; i++)
+        x->free_slots[x->free_count++] = x->opts.max_frontier - 1 - i;
+
+    heap_push(x, &x->cur[0]);
+
+    struct workers running;
+    workers_start(&running, threads, best_first_worker, workers, sizeof(*workers));
+    best_first_worker(&workers[0]);
+    workers_join(&running);
+}
+
+int explore(const struct chip *start, const struct explore_options *options, struct explore_result *result) {
+    memset(result, 0, sizeof(*result));
+
+    // clamp a copy, the caller may reuse theirs
+    struct explore_ctx x = {0};
+    x.opts = *options;
+    const struct explore_options *opts = &x.opts;
+    if (x.opts.max_depth > EXPLORE_MAX_DEPTH) x.opts.max_depth = EXPLORE_MAX_DEPTH;
+    if (x.opts.max_depth < 0) x.opts.max_depth = 0;
+    if (x.opts.max_frontier < 1) x.opts.max_frontier = 1;
+    if (x.opts.max_states < 1) x.opts.max_states = 1;
+
+    int threads = opts->threads;
+    if (threads <= 0) threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0) threads = 1;
+
+    // keep the table at most half full
+    uint64_t table_size = 1024;
+    while (table_size < (uint64_t) opts->max_states * 2) table_size <<= 1;
+
+    x.result = result;
+    x.table_mask = table_size - 1;
+    x.table = calloc(table_size, sizeof(*x.table));
+    x.nodes = malloc(opts->max_states * sizeof(*x.nodes));
+    atomic_init(&x.found, -1);
+    pthread_mutex_init(&x.lock, NULL);
+    pthread_cond_init(&x.wake, NULL);
+
+    // entries are chip_copy() destinations, so they start zeroed. pages nobody reaches are never touched
+    int best_first = opts->order == EXPLORE_BEST_FIRST;
+    x.cur = calloc(best_first ? 1 : opts->max_frontier, sizeof(*x.cur));
+    if (best_first) {
+        x.pool = calloc(opts->max_frontier, sizeof(*x.pool));
+        x.heap = malloc(opts->max_frontier * sizeof(*x.heap));
+        x.free_slots = malloc(opts->max_frontier * sizeof(*x.free_slots));
+    } else {
+        x.next = calloc(opts->max_frontier, sizeof(*x.next));
+    }
+
+    struct explore_worker *workers = calloc(threads, sizeof(*workers));
+    int ok = x.table && x.nodes && x.cur && workers
+        && (best_first ? x.pool && x.heap && x.free_slots : x.next != NULL);
+    for (int i = 0; ok && i < threads; i++) {
+        workers[i].ctx = &x;
+        workers[i].lanes = malloc(sizeof(*workers[i].lanes));
+        workers[i].children = calloc(EXPLORE_PARENTS * EXPLORE_KEYS, sizeof(*workers[i].children));
+        workers[i].parents = calloc(EXPLORE_PARENTS, sizeof(*workers[i].parents));
+        if (!workers[i].lanes || !workers[i].children || !workers[i].parents) ok = 0;
+        else chip_lanes_init(workers[i].lanes);
+    }
+
+    if (ok) {
+        // the start state is node 0 and the whole first frontier
+        x.nodes[EXPLORE_ROOT].parent = -1;
+        x.nodes[EXPLORE_ROOT].depth = 0;
+        atomic_store(&x.node_count, 1);
+        table_insert(&x, state_hash(start));
+        chip_copy(&x.cur[0].state, start);
+        x.cur[0].node = EXPLORE_ROOT;
+        x.cur[0].score = opts->score ? opts->score(start, opts->score_user) : 0;
+        x.cur_count = 1;
+
+        if (opts->target(start, opts->target_user)) {
+            atomic_store(&x.found, EXPLORE_ROOT);
+            chip_copy(&result->state, start);
+        } else if (best_first) {
+            explore_best_first(&x, workers, threads);
+        } else {
+            explore_breadth_first(&x, workers, threads);
+        }
+
+        int found = atomic_load(&x.found);
+        if (found >= 0) {
+            result->found = 1;
+            result->depth = x.nodes[found].depth;
+            for (int n = found; n != EXPLORE_ROOT; n = x.nodes[n].parent)
+                result->path[x.nodes[n].depth - 1] = x.nodes[n].key;
+        }
+
+        int states = atomic_load(&x.node_count);
+        result->states = states < opts->max_states ? states : opts->max_states;
+        result->duplicates = atomic_load(&x.duplicates);
+        result->dropped = atomic_load(&x.dropped);
+    } else {
+        printf("ERROR: Failed to allocate search state.\n");
+    }
+
+    for (int i = 0; workers && i < threads; i++) {
+        free(workers[i].lanes);
+        free(workers[i].children);
+        free(workers[i].parents);
+    }
+    free(workers);
+    pthread_cond_destroy(&x.wake);
+    pthread_mutex_destroy(&x.lock);
+    free(x.table);
+    free(x.nodes);
+    free(x.cur);
+    free(x.next);
+    free(x.pool);
+    free(x.heap);
+    free(x.free_slots);
+
+    return ok ? 0 : -1;
+}
@@ -0,0 +1,54 @@
+#ifndef EXPLORE
+#define EXPLORE
+
+#include "chip.h"
+#include "macros.h"
+#include <stdint.h>
+
+#define EXPLORE_MAX_DEPTH           64      /* longest input path we can report */
+#define EXPLORE_KEYS                16      /* inputs tried from every state, one per key */
+
+enum explore_order {
+    EXPLORE_BREADTH_FIRST,
+    EXPLORE_BEST_FIRST,
+};
+
+/* returns non-zero when c is the state we are looking for */
+typedef int (*explore_predicate)(const struct chip *c, void *user);
+/* lower is closer to the target. used to order the best-first search */
+typedef int (*explore_score)(const struct chip *c, void *user);
+
+/* laid out like chip.planes. set bits with CHIP_ROW_BIT */
+struct explore_pattern {
+    chip_row planes[CHIP_8_PLANES][CHIP_8_HIRES_HEIGHT];
+    chip_row mask[CHIP_8_PLANES][CHIP_8_HIRES_HEIGHT];     /* only pixels set here are compared */
+};
+
+struct explore_options {
+    int frames_per_input;   /* frames each key is held for */
+    int cycles_per_frame;   /* chip-8 instructions per frame */
+    int max_depth;          /* longest input sequence to try, at most EXPLORE_MAX_DEPTH */
+    int max_states;         /* distinct states to visit before giving up */
+    int max_frontier;       /* states waiting to be expanded. more are dropped */
+    int threads;            /* worker threads. 0 picks one per core */
+    enum explore_order order;
+    explore_predicate target;
+    void *target_user;
+    explore_score score;    /* best-first only. NULL falls back to depth */
+    void *score_user;
+};
+
+struct explore_result {
+    int found;
+    int depth;                          /* number of inputs in path */
+    uint8_t path[EXPLORE_MAX_DEPTH];    /* key held for each step, oldest first */
+    long states;                        /* distinct states visited */
+    long duplicates;                    /* states reached again and thrown away */
+    long dropped;                       /* states lost to a full frontier */
+    struct chip state;                  /* the target state, when found */
+};
+
+int explore_pattern_match(const struct chip *c, void *pattern);
+int explore(const struct chip *start, const struct explore_options *opts, struct explore_result *result);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef HASH
+#define HASH
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t hash64(const void *data, size_t len, uint64_t seed);
+
+#endif
@@ -0,0 +1,304 @@
+#include "lanes.h"
+#include "chip.h"
+#include "chip_return.h"
+#include "macros.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+ * every step groups the active lanes by the opcode they are about to run.
+ * each group that is a pure register op runs as a handful of vector
+ * instructions under a lane mask; anything else is handed to chip_cycle()
+ * one lane at a time.
+ */
+
+/* lane-wise m ? a : b. macros rather than functions so no vector crosses a call */
+#define blend8(m, a, b)     ((lane_u8) (((lane_i8) (a) & (m)) | ((lane_i8) (b) & ~(m))))
+#define blend16(m, a, b)    ((lane_u16) (((lane_i16) (a) & (m)) | ((lane_i16) (b) & ~(m))))
+
+static void sync_out(struct chip_lanes *l, int lane) {
+    struct chip *c = &l->chips[lane];
+    for (int r = 0; r < CHIP_8_REGISTERS; r++)
+        c->registers[r] = l->v[r][lane];
+    c->pc = l->pc[lane];
+    c->idx = l->idx[lane];
+    c->delay_timer = l->delay_timer[lane];
+    c->sound_timer = l->sound_timer[lane];
+}
+
+static void sync_in(struct chip_lanes *l, int lane) {
+    struct chip *c = &l->chips[lane];
+    for (int r = 0; r < CHIP_8_REGISTERS; r++)
+        l->v[r][lane] = c->registers[r];
+    l->pc[lane] = c->pc;
+    l->idx[lane] = c->idx;
+    l->delay_timer[lane] = c->delay_timer;
+    l->sound_timer[lane] = c->sound_timer;
+}
+
+void chip_lanes_init(struct chip_lanes *l) {
+    memset(l, 0, sizeof(*l));
+}
+
+void chip_lanes_reset(struct chip_lanes *l) {
+    // drop every lane without paying for a memset over all of them
+    l->active = 0;
+    l->live = (lane_i8) {0};
+    l->diverged = 0;
+}
+
+void chip_lanes_set(struct chip_lanes *l, int lane, const struct chip *c) {
+    chip_copy(&l->chips[lane], c);
+    sync_in(l, lane);
+    l->active |= 1u << lane;
+    l->live[lane] = -1;
+    l->quirk_vf_reset[lane] = (c->quirks & CHIP_QUIRK_VF_RESET) ? -1 : 0;
+    l->quirk_shift[lane] = (c->quirks & CHIP_QUIRK_SHIFT) ? -1 : 0;
+}
+
+void chip_lanes_get(struct chip_lanes *l, int lane, struct chip *c) {
+    sync_out(l, lane);
+    chip_copy(c, &l->chips[lane]);
+}
+
+void chip_lanes_key(struct chip_lanes *l, int lane, int key, int down) {
+    struct chip *c = &l->chips[lane];
+    c->keys[key] = down;
+    if (down && !c->key_wait_filled) {
+        l->v[c->key_register][lane] = (uint8_t) key;
+        c->key_wait_filled = 1;
+    }
+}
+
+static inline uint32_t lane_bits(const lane_i8 *m) {
+    // one bit per lane from a vector mask
+#if defined(__AVX2__) && CHIP_LANES == 32
+    return (uint32_t) _mm256_movemask_epi8((__m256i) *m);
+#elif defined(__SSE2__) && CHIP_LANES == 32
+    return (uint32_t) _mm_movemask_epi8(((__m128i *) m)[0])
+        | (uint32_t) _mm_movemask_epi8(((__m128i *) m)[1]) << 16;
+#else
+    uint32_t bits = 0;
+    for (int i = 0; i < CHIP_LANES; i++)
+        bits |= (uint32_t) ((*m)[i] & 1) << i;
+    return bits;
+#endif
+}
+
+static int vector_op(uint16_t op) {
+    // the opcodes we can run across lanes. only a taken skip looks at per-lane memory
+    switch (op >> 12) {
+        case 0x1: case 0x3: case 0x4: case 0x6: case 0x7: case 0xA:
+            return 1;
+        case 0x5: case 0x9:
+            return (op & 0xF) == 0;
+        case 0x8:
+            return (op & 0xF) <= 0x7 || (op & 0xF) == 0xE;
+        default:
+            return 0;
+    }
+}
+
+static void run_vector(struct chip_lanes *l, uint16_t op, const lane_i8 *mask) {
+    lane_i8 m = *mask;
+    int x = (op & 0x0F00) >> 8;
+    int y = (op & 0x00F0) >> 4;
+    uint8_t nn = op & 0x00FF;
+    lane_i16 m16 = __builtin_convertvector(m, lane_i16);
+    lane_u8 vx = l->v[x];
+    lane_u8 vy = l->v[y];
+    lane_i8 skip = {0};
+
+    switch (op >> 12) {
+        case 0x1:
+            // 1NNN
+            l->pc = blend16(m16, (lane_u16) {0} + (uint16_t) (op & 0x0FFF), l->pc);
+            return;
+        case 0x3:
+            // 3XNN
+            skip = vx == nn;
+            break;
+        case 0x4:
+            // 4XNN
+            skip = vx != nn;
+            break;
+        case 0x5:
+            // 5XY0
+            skip = vx == vy;
+            break;
+        case 0x9:
+            // 9XY0
+            skip = vx != vy;
+            break;
+        case 0x6:
+            // 6XNN
+            l->v[x] = blend8(m, (lane_u8) {0} + nn, vx);
+            break;
+        case 0x7:
+            // 7XNN
+            l->v[x] = blend8(m, vx + nn, vx);
+            break;
+        case 0xA:
+            // ANNN
+            l->idx = blend16(m16, (lane_u16) {0} + (uint16_t) (op & 0x0FFF), l->idx);
+            break;
+        case 0x8: {
+            // same order of writes as decode(), so X == F and X == Y come out identical
+            lane_u8 res;
+            lane_u8 flag;
+            switch (op & 0xF) {
+                case 0x0: l->v[x] = blend8(m, vy, vx); break;
+                case 0x1:
+                case 0x2:
+                case 0x3:
+                    res = (op & 0xF) == 0x1 ? vx | vy : (op & 0xF) == 0x2 ? vx & vy : vx ^ vy;
+                    l->v[x] = blend8(m, res, vx);
+                    l->v[0xF] = blend8(m & l->quirk_vf_reset, (lane_u8) {0}, l->v[0xF]);
+                    break;
+                case 0x4:
+                    res = vx + vy;
+                    l->v[x] = blend8(m, res, vx);
+                    flag = (lane_u8) (l->v[x] < vx) & 1;
+                    l->v[0xF] = blend8(m, flag, l->v[0xF]);
+                    break;
+                case 0x5:
+                    res = vx - vy;
+                    l->v[x] = blend8(m, res, vx);
+                    flag = (lane_u8) (l->v[x] < vx) & 1;
+                    l->v[0xF] = blend8(m, flag, l->v[0xF]);
+                    break;
+                case 0x6:
+                    res = blend8(l->quirk_shift, vx, vy);
+                    flag = res & 1;
+                    l->v[x] = blend8(m, res >> 1, vx);
+                    l->v[0xF] = blend8(m, flag, l->v[0xF]);
+                    break;
+                case 0x7:
+                    l->v[x] = blend8(m, vy - vx, vx);
+                    flag = (lane_u8) (l->v[x] < l->v[y]) & 1;
+                    l->v[0xF] = blend8(m, flag, l->v[0xF]);
+                    break;
+                case 0xE:
+                    res = blend8(l->quirk_shift, vx, vy);
+                    flag = res >> 7;
+                    l->v[x] = blend8(m, res << 1, vx);
+                    l->v[0xF] = blend8(m, flag, l->v[0xF]);
+                    break;
+            }
+            break;
+        }
+    }
+
+    // a taken skip over F000 NNNN has to clear all four bytes of it
+    lane_i8 taken = skip & m;
+    for (uint32_t t = lane_bits(&taken); t; t &= t - 1) {
+        int lane = __builtin_ctz(t);
+        l->pc[lane] += chip_skip_width(&l->chips[lane], l->pc[lane] + 2) - 2;
+    }
+
+    // advance past the instruction, and past the next one on a taken skip
+    lane_i16 skip16 = __builtin_convertvector(taken, lane_i16);
+    l->pc += (lane_u16) (m16 & 2) + (lane_u16) (skip16 & 2);
+}
+
+static void kill_lane(struct chip_lanes *l, int lane) {
+    l->active &= ~(1u << lane);
+    l->live[lane] = 0;
+}
+
+static void run_scalar(struct chip_lanes *l, int lane) {
+    sync_out(l, lane);
+    struct chip_return status = chip_cycle(&l->chips[lane]);
+    sync_in(l, lane);
+    if (status.decode_status < 0)
+        kill_lane(l, lane);
+}
+
+static int step(struct chip_lanes *l) {
+    int groups = 0;
+    uint16_t fetched[CHIP_LANES];
+    for (int i = 0; i < CHIP_LANES; i++) {
+        const uint8_t *ram = l->chips[i].ram;
+        uint16_t pc = l->pc[i];
+        fetched[i] = (ram[pc & CHIP_8_RAM_MASK] << 8) | ram[(pc + 1) & CHIP_8_RAM_MASK];
+    }
+    lane_u16 ops;
+    memcpy(&ops, fetched, sizeof(ops));
+
+    uint32_t pending = l->active;
+    lane_i8 pending_mask = l->live;
+
+    while (pending) {
+        uint16_t op = fetched[__builtin_ctz(pending)];
+
+        // every pending lane about to run the same opcode as the first one
+        lane_i8 m = __builtin_convertvector(ops == op, lane_i8) & pending_mask;
+        pending_mask &= ~m;
+        uint32_t group = lane_bits(&m);
+        pending &= ~group;
+        groups++;
+
+        if (vector_op(op)) {
+            run_vector(l, op, &m);
+        } else {
+            for (; group; group &= group - 1)
+                run_scalar(l, __builtin_ctz(group));
+        }
+    }
+
+    return groups;
+}
+
+int chip_lanes_step(struct chip_lanes *l) {
+    step(l);
+    return __builtin_popcount(l->active);
+}
+
+static void run_scalar_frame(struct chip_lanes *l, int cycles) {
+    for (uint32_t a = l->active; a; a &= a - 1) {
+        int lane = __builtin_ctz(a);
+        sync_out(l, lane);
+        for (int i = 0; i < cycles; i++) {
+            if (chip_cycle(&l->chips[lane]).decode_status < 0) {
+                kill_lane(l, lane);
+                break;
+            }
+        }
+        sync_in(l, lane);
+    }
+}
+
+static int converged(struct chip_lanes *l) {
+    // every running lane sitting on the same pc
+    uint16_t pc = l->pc[__builtin_ctz(l->active)];
+    lane_i8 m = __builtin_convertvector(l->pc == pc, lane_i8) & l->live;
+    return lane_bits(&m) == l->active;
+}
+
+int chip_lanes_frame(struct chip_lanes *l, int cycles) {
+    if (l->active && l->diverged && !converged(l)) {
+        // still apart since the last frame, don't bother grouping
+        run_scalar_frame(l, cycles);
+    } else {
+        l->diverged = 0;
+        for (int i = 0; i < cycles && l->active; i++) {
+            if (step(l) > CHIP_LANES_DIVERGED) {
+                // too scattered for masking to pay off. finish the frame lane by lane
+                l->diverged = 1;
+                run_scalar_frame(l, cycles - i - 1);
+                break;
+            }
+        }
+    }
+
+    // decrement_timers() on every lane
+    l->delay_timer -= (lane_u8) (l->delay_timer != 0) & 1;
+    l->sound_timer -= (lane_u8) (l->sound_timer != 0) & 1;
+
+    return __builtin_popcount(l->active);
+}
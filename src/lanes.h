@@ -0,0 +1,46 @@
+#ifndef LANES
+#define LANES
+
+#include "chip.h"
+#include <stdint.h>
+
+#define CHIP_LANES                  32      /* machines stepped together. one byte per lane fills an AVX2 register */
+#define CHIP_LANES_DIVERGED         4       /* opcode groups in one step before a frame falls back to scalar */
+
+typedef uint8_t  lane_u8  __attribute__((vector_size(CHIP_LANES)));
+typedef int8_t   lane_i8  __attribute__((vector_size(CHIP_LANES)));
+typedef uint16_t lane_u16 __attribute__((vector_size(CHIP_LANES * 2)));
+typedef int16_t  lane_i16 __attribute__((vector_size(CHIP_LANES * 2)));
+
+/*
+ * up to CHIP_LANES independent machines in structure-of-arrays form.
+ * the hot registers live in vectors with one lane per machine, so when lanes
+ * agree on the next opcode the ALU and skip instructions run across all of
+ * them at once. everything else (ram, stack, display, keys) stays in a
+ * struct chip per lane, and lanes that diverge or hit anything else go
+ * through the scalar core.
+ */
+struct chip_lanes {
+    lane_u8 v[CHIP_8_REGISTERS];                    /* V0-VF, one lane per machine */
+    lane_u16 pc;
+    lane_u16 idx;
+    lane_u8 delay_timer;
+    lane_u8 sound_timer;
+    uint32_t active;                                /* lanes still running. cleared on an illegal instruction */
+    lane_i8 live;                                   /* active, as a lane mask */
+    int diverged;                                   /* last frame fell back to scalar */
+    lane_i8 quirk_vf_reset;                         /* lanes with CHIP_QUIRK_VF_RESET */
+    lane_i8 quirk_shift;                            /* lanes with CHIP_QUIRK_SHIFT */
+    struct chip chips[CHIP_LANES];                  /* the rest of each machine. registers in here are stale */
+};
+
+void chip_lanes_init(struct chip_lanes *l);
+void chip_lanes_reset(struct chip_lanes *l);
+void chip_lanes_set(struct chip_lanes *l, int lane, const struct chip *c);
+/* c must be a reset or zeroed machine, like any chip_copy() destination */
+void chip_lanes_get(struct chip_lanes *l, int lane, struct chip *c);
+void chip_lanes_key(struct chip_lanes *l, int lane, int key, int down);
+int chip_lanes_step(struct chip_lanes *l);
+int chip_lanes_frame(struct chip_lanes *l, int cycles);
+
+#endif
@@ -3,13 +3,40 @@
 
 #define CHIP_8_WIDTH                64      /* width of chip-8 in pixels */
 #define CHIP_8_HEIGHT               32      /* height of chip-8 in pixels */
+#define CHIP_8_HIRES_WIDTH          128     /* width in super-chip hires mode */
+#define CHIP_8_HIRES_HEIGHT         64      /* height in super-chip hires mode */
+#define CHIP_8_PLANES               2       /* xo-chip bitplanes */
+#define CHIP_8_RAM                  65536   /* xo-chip's 64kb. size of RAM */
+#define CHIP_8_RAM_MASK             (CHIP_8_RAM - 1)    /* every ram access is masked with this, so RAM must be a power of two */
+#define CHIP_8_RAM_PAGE             0x1000  /* the original 4kb. ram_top grows in steps of this */
+#define CHIP_8_STACK_MAX            16
+#define CHIP_8_STACK_MASK           (CHIP_8_STACK_MAX - 1)
+#define CHIP_8_REGISTERS            16
+#define CHIP_8_KEYS                 16
+#define CHIP_8_PROGRAM_START        0x200   /* roms are loaded here */
+#define CHIP_8_FONT_START           0x50    /* font is loaded here */
+#define CHIP_8_BIG_FONT_START       0xA0    /* 8x10 super-chip font, right after the small one */
+#define CHIP_8_FLAGS                16      /* FX75/FX85 flag registers */
+#define CHIP_8_AUDIO_PATTERN        16      /* bytes in the xo-chip audio pattern, one bit per sample */
+#define CHIP_8_AUDIO_PITCH          64      /* FX3A pitch that plays the pattern at 4000 samples a second */
+#define CHIP_8_ROM_MAX              (CHIP_8_RAM - CHIP_8_PROGRAM_START)  /* largest rom that fits */
+
+/* behaviours that differ between interpreters. none set is the original COSMAC VIP, minus VF reset */
+#define CHIP_QUIRK_VF_RESET         0x1     /* 8XY1, 8XY2 and 8XY3 clear VF */
+#define CHIP_QUIRK_SHIFT            0x2     /* 8XY6 and 8XYE shift VX in place and ignore VY */
+#define CHIP_QUIRK_JUMP             0x4     /* BNNN is BXNN, jumping to XNN + VX */
+#define CHIP_QUIRK_MEMORY           0x8     /* FX55 and FX65 leave index unchanged */
 
 #define SDL_WINDOW_TITLE            "woodchip"
 #define SDL_WINDOW_WIDTH            (CHIP_8_WIDTH * WINDOW_SIZE_MODIFIER)
 #define SDL_WINDOW_HEIGHT           (CHIP_8_HEIGHT * WINDOW_SIZE_MODIFIER)
 #define SDL_FPS                     60      /* we run at 60 fps, the same speed as the chip-8 timers */
-#define BLACK                       0 ,0 ,0 ,255
-#define WHITE                       255, 255, 255, 255
+#define FAST_FORWARD_FRAMES         8       /* frames run per frame shown while tab is held */
+#define PALETTE_BACKGROUND          0x000000    /* default colors, 0xRRGGBB. indexed by plane 1 bit | plane 2 bit << 1 */
+#define PALETTE_FOREGROUND          0xFFFFFF
+#define PALETTE_PLANE_2             0xAAAAAA
+#define PALETTE_BLEND               0x555555
+#define PALETTE_COLORS              4
 
 #define SOUND_SAMPLE_RATE           44100
 #define SOUND_FREQUENCY             440
@@ -2,26 +2,59 @@
 #include "usage.h"
 #include "macros.h"
 #include "chip_return.h"
+#include "batch.h"
+#include "romdb.h"
+#include "debug.h"
+#include "sound.h"
+#include "capture.h"
+#include "perf.h"
 
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 
 SDL_Window* sdl_window;
 SDL_Renderer* sdl_renderer;
+SDL_Texture* sdl_texture;
 SDL_Event sdl_event;
 SDL_AudioSpec sdl_audio;
 SDL_AudioStream* sdl_audio_stream;
 
 int WINDOW_SIZE_MODIFIER = 16;
 int CHIP_8_CYCLES_PER_FRAME = 12;
+uint32_t CHIP_8_QUIRKS = 0;
+uint32_t PALETTE[PALETTE_COLORS] = {PALETTE_BACKGROUND, PALETTE_FOREGROUND, PALETTE_PLANE_2, PALETTE_BLEND};
+
+struct chip chip8;
+struct debug debugger;
+struct debug *chip8_debug = NULL;   /* &debugger when -g is given */
+struct capture capture;
+struct capture *chip8_capture = NULL;   /* &capture when -r is given */
+struct perf perf;
+struct perf *chip8_perf = NULL;         /* &perf when -p is given */
+uint64_t start_ns;                      /* when main was entered, for time to first frame */
+
+/* everything that gets the machine ready, run while the window is created */
+struct setup {
+    struct romdb *db;
+    int keep;
+    int save;
+    char *db_path;
+    char *debug_path;
+    char *capture_path;
+    char *file;
+    int status;
+};
 
 int init_sdl() {
-    if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_EVENTS)) {
+    // audio waits until a rom makes a sound, see open_audio
+    if (!SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS)) {
         printf("ERROR: Failed to initialize SDL3: %s\n", SDL_GetError());
         return -1;
     }
@@ -38,12 +71,33 @@ int init_sdl() {
         return -1;
     }
 
+    // the display is drawn into this and scaled up, hires or lores
+    sdl_texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_XRGB8888, SDL_TEXTUREACCESS_STREAMING, CHIP_8_HIRES_WIDTH, CHIP_8_HIRES_HEIGHT);
+    if (!sdl_texture) {
+        printf("ERROR: Failed to create texture: %s\n", SDL_GetError());
+        return -1;
+    }
+    SDL_SetTextureScaleMode(sdl_texture, SDL_SCALEMODE_NEAREST);
+
     int vsync = SDL_SetRenderVSync(sdl_renderer, 1);
     if (vsync != 1) {
         printf("ERROR: Failed to initialize VSync: %s\n", SDL_GetError());
         return -1;
     }
 
+    SDL_SetRenderDrawColor(sdl_renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+
+    return 0;
+}
+
+int open_audio() {
+    // opening the device takes tens of milliseconds and many roms never beep,
+    // so it waits for the first sound instead of holding up startup
+    if (!SDL_InitSubSystem(SDL_INIT_AUDIO)) {
+        printf("ERROR: Failed to initialize SDL3 audio: %s\n", SDL_GetError());
+        return -1;
+    }
+
     sdl_audio.freq = SOUND_SAMPLE_RATE;
     sdl_audio.format = SDL_AUDIO_F32;
     sdl_audio.channels = 1;
@@ -52,14 +106,12 @@ int init_sdl() {
         printf("ERROR: Failed to create audio stream: %s\n", SDL_GetError());
         return -1;
     }
-
-    SDL_SetRenderDrawColor(sdl_renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
-    SDL_RenderPresent(sdl_renderer);
-
     return 0;
 }
 
 int destroy_sdl() {
+    // also undoes a partial init_sdl, SDL ignores the handles it never made
+    SDL_DestroyTexture(sdl_texture);
     SDL_DestroyRenderer(sdl_renderer);
     SDL_DestroyWindow(sdl_window);
     SDL_Quit();
@@ -100,43 +152,75 @@ int scan_to_chip(SDL_Scancode s) {
     }
 }
 
-void draw_screen() {
-    SDL_RenderClear(sdl_renderer);
-    for (int i=0; i<CHIP_8_WIDTH; i++) {
-        for (int j=0; j<CHIP_8_HEIGHT; j++) {
-            if (pixels[i][j] == 1) {
-                SDL_SetRenderDrawColor(sdl_renderer, WHITE);
-            } else {
-                SDL_SetRenderDrawColor(sdl_renderer, BLACK);
+void draw_screen(int changed) {
+    // the texture keeps the last display, so only rebuild it when it changed
+    static uint32_t texels[CHIP_8_HIRES_HEIGHT][CHIP_8_HIRES_WIDTH];
+    int w = chip_width(&chip8);
+    int h = chip_height(&chip8);
+    if (changed) {
+        for (int y=0; y<h; y++) {
+            chip_row p0 = chip8.planes[0][y];
+            chip_row p1 = chip8.planes[1][y];
+            for (int x=0; x<w; x++) {
+                int shift = CHIP_8_HIRES_WIDTH - 1 - x;
+                texels[y][x] = PALETTE[((p0 >> shift) & 1) | ((p1 >> shift) & 1) << 1];
             }
-            SDL_FRect f = {i * WINDOW_SIZE_MODIFIER, j * WINDOW_SIZE_MODIFIER, WINDOW_SIZE_MODIFIER, WINDOW_SIZE_MODIFIER};
-            SDL_RenderFillRect(sdl_renderer, &f);
         }
+        SDL_UpdateTexture(sdl_texture, NULL, texels, sizeof(texels[0]));
     }
-    SDL_RenderPresent(sdl_renderer);
+
+    SDL_FRect src = {0, 0, w, h};
+    SDL_RenderClear(sdl_renderer);
+    SDL_RenderTexture(sdl_renderer, sdl_texture, &src, NULL);
+}
+
+void draw_hud() {
+    char lines[PERF_HUD_LINES][64];
+    int n = perf_hud(&chip8_perf->last, lines);
+    size_t longest = 0;
+    for (int i=0; i<n; i++)
+        if (strlen(lines[i]) > longest) longest = strlen(lines[i]);
+
+    // yellow on a dimmed box in the top left corner
+    SDL_FRect box = {0, 0, 8 + longest * SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE, 8 + n * (SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + 2)};
+    SDL_SetRenderDrawColor(sdl_renderer, 0, 0, 0, 160);
+    SDL_RenderFillRect(sdl_renderer, &box);
+    SDL_SetRenderDrawColor(sdl_renderer, 255, 255, 0, SDL_ALPHA_OPAQUE);
+    for (int i=0; i<n; i++)
+        SDL_RenderDebugText(sdl_renderer, 4, 4 + i * (SDL_DEBUG_TEXT_FONT_CHARACTER_SIZE + 2), lines[i]);
+    SDL_SetRenderDrawColor(sdl_renderer, 0, 0, 0, SDL_ALPHA_OPAQUE);
+}
+
+double audio_queued_ms() {
+    // how far ahead of the device we are, -1 without an audio stream
+    if (!sdl_audio_stream) return -1;
+    int bytes = SDL_GetAudioStreamQueued(sdl_audio_stream);
+    return bytes < 0 ? -1 : bytes * 1000.0 / (sizeof(float) * SOUND_SAMPLE_RATE);
 }
 
 void play_sound(int play) {
+    static int no_audio = 0;   /* open_audio failed, stay silent rather than retry every frame */
     if (play) {
+        if (!sdl_audio_stream && (no_audio || open_audio() != 0)) {
+            no_audio = 1;
+            return;
+        }
         int sample_size = 1024;
-        const float phase_increment = 2.0f * SDL_PI_F * SOUND_FREQUENCY / (float)SOUND_SAMPLE_RATE;
-        static float current_phase = 0.0f;
         float samples[sample_size];
-        for (int i=0; i<sample_size; i++) {
-            samples[i] = SDL_sinf(current_phase);
-            current_phase+=phase_increment;
-            if (current_phase >=2 * SDL_PI_F)
-                current_phase -= 2*SDL_PI_F;
-        }
+        static struct sound tone;
+        sound_fill(&tone, chip8.pattern_loaded ? chip8.pattern : NULL, chip8.pitch, samples, sample_size);
         SDL_PutAudioStreamData(sdl_audio_stream, samples, sizeof(samples));
         SDL_ResumeAudioStreamDevice(sdl_audio_stream);
-    } else {
+    } else if (sdl_audio_stream) {
         SDL_PauseAudioStreamDevice(sdl_audio_stream);
     }
 }
 
 void program_loop() {
     int running = 0;
+    int fast_forward = 0;
+    int first = 1;
+    if (chip8_perf) perf_start(chip8_perf, SDL_GetTicksNS());
     while (running == 0) {
         uint64_t render_start = SDL_GetTicksNS();
         while (SDL_PollEvent(&sdl_event)) {
@@ -147,21 +231,20 @@ void program_loop() {
                     break;
 
                 case SDL_EVENT_KEY_DOWN: {
+                    if (sdl_event.key.scancode == SDL_SCANCODE_TAB)
+                        fast_forward = 1;
                     int key = scan_to_chip(sdl_event.key.scancode);
-                    if (key != -1) {
-                        keys[key] = 1;
-                        if (!key_wait_filled) {
-                            *key_register = (uint8_t) key;
-                            key_wait_filled = 1;
-                        }
-                    }
+                    if (key != -1)
+                        chip_key(&chip8, key, 1);
                     break;
                 }
 
                 case SDL_EVENT_KEY_UP: {
+                    if (sdl_event.key.scancode == SDL_SCANCODE_TAB)
+                        fast_forward = 0;
                     int key = scan_to_chip(sdl_event.key.scancode);
                     if (key != -1)
-                        keys[key] = 0;
+                        chip_key(&chip8, key, 0);
                     break;
                 }
                     
@@ -170,16 +253,43 @@ void program_loop() {
             }
         }
         
+        // fast forward runs several frames for every one shown
+        int frames = fast_forward ? FAST_FORWARD_FRAMES : 1;
         int draw = 0;
         int sound = 0;
-        for (int i=0; i<CHIP_8_CYCLES_PER_FRAME; i++) {
-            struct chip_return status = chip_cycle();
-            if (status.decode_status) draw = 1;
-            if (status.sound_status) sound = 1;
+        int emulated = 0;
+        for (; emulated<frames && !chip8.halted; emulated++) {
+            struct chip_return status = chip_run(&chip8, CHIP_8_CYCLES_PER_FRAME, chip8_debug);
+            if (status.decode_status < 0)
+                printf("ERROR: Failed to decode instruction: %x\n", status.opcode);
+            if (status.decode_status != 0) draw = 1;
+            sound = status.sound_status != 0;
+            if (chip8_capture) capture_frame(chip8_capture, &chip8);
+            decrement_timers(&chip8);
         }
-        if (draw) draw_screen();
         play_sound(sound);
-        decrement_timers();
+        if (chip8_perf) {
+            perf_emulated(chip8_perf, emulated, CHIP_8_CYCLES_PER_FRAME);
+            perf_phase(chip8_perf, PERF_EMULATE, SDL_GetTicksNS());
+        }
+
+        // the hud changes every frame, so with it on we always present
+        if (draw || chip8_perf || first) {
+            draw_screen(draw || first);
+            if (chip8_perf) {
+                draw_hud();
+                perf_phase(chip8_perf, PERF_RENDER, SDL_GetTicksNS());
+            }
+            SDL_RenderPresent(sdl_renderer);
+            if (chip8_perf) perf_phase(chip8_perf, PERF_PRESENT, SDL_GetTicksNS());
+        }
+        if (first) {
+            printf("First frame after %.2f ms\n", (SDL_GetTicksNS() - start_ns) / 1e6);
+            first = 0;
+        }
+
+        // 00FD
+        if (chip8.halted) running = -1;
 
         // cap at 60FPS
         uint64_t render_time = SDL_GetTicksNS() - render_start;
@@ -189,17 +299,79 @@ void program_loop() {
             SDL_DelayNS(sleep);
         }
 
-        /*
-        uint64_t fps = 10000000 / render_time;
-        printf("fps: %ld\n", fps);
-        */
+        if (chip8_perf) {
+            uint64_t now = SDL_GetTicksNS();
+            perf_phase(chip8_perf, PERF_SLEEP, now);
+            perf_frame(chip8_perf, now - render_start);
+            if (perf_report(chip8_perf, now, audio_queued_ms()))
+                perf_print(&chip8_perf->last, stderr, NULL);
+        }
+    }
+}
+
+int load_settings(struct romdb *db, int keep, int save, char *db_path) {
+    // fill in whatever the command line left out from the rom database
+    uint64_t hash = romdb_hash(&chip8);
+    const struct romdb_entry *e = romdb_find(db, hash);
+    if (e) romdb_apply(e, keep, &CHIP_8_CYCLES_PER_FRAME, &CHIP_8_QUIRKS, PALETTE);
+    chip8.quirks = CHIP_8_QUIRKS;
+
+    if (save) {
+        struct romdb_entry entry = {hash, CHIP_8_QUIRKS, CHIP_8_CYCLES_PER_FRAME, {0}};
+        memcpy(entry.palette, PALETTE, sizeof(entry.palette));
+        if (romdb_store(db_path, &entry) != 0) return -1;
+        printf("Saved settings for %016llx to %s\n", (unsigned long long) hash, db_path);
+    }
+    return 0;
+}
+
+void *setup_core(void *arg) {
+    struct setup *s = arg;
+    s->status = -1;
+
+    int loaded = load_settings(s->db, s->keep, s->save, s->db_path);
+    romdb_close(s->db);
+    if (loaded != 0) {
+        return NULL;
+    }
+
+    if (s->debug_path) {
+        if (debug_open(&debugger, s->debug_path) != 0) {
+            return NULL;
+        }
+        debug_attach(&debugger, s->file);
+        chip8_debug = &debugger;
+        printf("Debugger listening on %s\n", s->debug_path);
+    }
+
+    if (s->capture_path) {
+        // the window is 64 pixels times -w across, so the capture matches it
+        if (capture_open(&capture, s->capture_path, WINDOW_SIZE_MODIFIER / 2, PALETTE, 1) != 0) {
+            return NULL;
+        }
+        chip8_capture = &capture;
+        printf("Recording to %s.y4m and %s.wav\n", s->capture_path, s->capture_path);
     }
+
+    s->status = 0;
+    return NULL;
 }
 
 int main(int argc, char *argv[]) {
+    // the same clock as the frame loop. it starts on first use, SDL_Init isn't needed
+    start_ns = SDL_GetTicksNS();
     srand(time(NULL));
 
     char *file;
+    int batch = 0;
+    struct batch_options batch_opts = {BATCH_DEFAULT_FRAMES, 0, 0, 0};
+    char db_default[4096];
+    char *db_path = romdb_default_path(db_default, sizeof(db_default)) == 0 ? db_default : NULL;
+    int keep = 0;   /* ROMDB_* settings given on the command line */
+    int save = 0;
+    char *debug_path = NULL;
+    char *capture_path = NULL;
+    int show_perf = 0;
     // if no arguments, return immediately
     if (argc == 1) {
         print_usage();
@@ -222,28 +394,138 @@ int main(int argc, char *argv[]) {
         } else if (strcmp(argv[i], "-t") == 0) {
             if (argv[++i]) {
                 CHIP_8_CYCLES_PER_FRAME = atoi(argv[i]);
+                keep |= ROMDB_CYCLES;
+            } else {
+                print_usage();
+                return 0;
+            }
+        } else if (strcmp(argv[i], "-q") == 0) {
+            if (argv[++i]) {
+                CHIP_8_QUIRKS = strtoul(argv[i], NULL, 0);
+                keep |= ROMDB_QUIRKS;
+            } else {
+                print_usage();
+                return 0;
+            }
+        } else if (strcmp(argv[i], "-c") == 0) {
+            if (argv[++i] && sscanf(argv[i], "%x,%x,%x,%x", &PALETTE[0], &PALETTE[1], &PALETTE[2], &PALETTE[3]) >= 2) {
+                keep |= ROMDB_PALETTE;
+            } else {
+                print_usage();
+                return 0;
+            }
+        } else if (strcmp(argv[i], "-d") == 0) {
+            if (argv[++i]) {
+                db_path = argv[i];
+            } else {
+                print_usage();
+                return 0;
+            }
+        } else if (strcmp(argv[i], "-g") == 0) {
+            if (argv[++i]) {
+                debug_path = argv[i];
+            } else {
+                print_usage();
+                return 0;
+            }
+        } else if (strcmp(argv[i], "-r") == 0) {
+            if (argv[++i]) {
+                capture_path = argv[i];
+            } else {
+                print_usage();
+                return 0;
+            }
+        } else if (strcmp(argv[i], "-p") == 0) {
+            show_perf = 1;
+        } else if (strcmp(argv[i], "-s") == 0) {
+            save = 1;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            if (argv[++i]) {
+                batch_opts.frames = atoi(argv[i]);
+            } else {
+                print_usage();
+                return 0;
+            }
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (argv[++i]) {
+                batch_opts.threads = atoi(argv[i]);
             } else {
                 print_usage();
                 return 0;
             }
+        } else if (strcmp(argv[i], "-u") == 0) {
+            batch_opts.update = 1;
         }
     }
 
     file = argv[argc-1];
+
+    // mapped once and shared by every rom we open
+    struct romdb db = {0};
+    if (db_path && romdb_open(&db, db_path) != 0) {
+        return -1;
+    }
+
+    if (batch) {
+        // headless, no SDL at all
+        batch_opts.cycles_per_frame = CHIP_8_CYCLES_PER_FRAME;
+        batch_opts.quirks = CHIP_8_QUIRKS;
+        batch_opts.keep = keep;
+        batch_opts.db = &db;
+        batch_opts.debug_path = debug_path;
+        batch_opts.capture_dir = capture_path;
+        batch_opts.capture_scale = WINDOW_SIZE_MODIFIER / 2;
+        batch_opts.palette = PALETTE;
+        batch_opts.perf = show_perf;
+        int status = batch_run(file, &batch_opts);
+        romdb_close(&db);
+        return status;
+    }
+
+
     printf("Loading file: %s\n", file);
 
-    if(init_sdl() != 0) {
+    // a bad rom fails here, before any window shows up
+    int loaded = chip_init(&chip8, file, (uint32_t) rand());
+    if (loaded != 0) {
+        printf("ERROR: File %s %s.\n", file, chip_error(loaded));
+        romdb_close(&db);
+        return -1;
+    }
+
+    if (save && !db_path) {
+        printf("ERROR: No rom database to save to. Pass one with -d.\n");
+        romdb_close(&db);
         return -1;
     }
 
-    if(chip_init(file) != 0) {
-        chip_clean();
+    // SDL wants the main thread, so the rest of the setup goes on another
+    // while the window and renderer are created
+    struct setup setup = {&db, keep, save, db_path, debug_path, capture_path, file, -1};
+    pthread_t setup_thread;
+    int overlapped = pthread_create(&setup_thread, NULL, setup_core, &setup) == 0;
+    if (!overlapped) setup_core(&setup);
+    int sdl = init_sdl();
+    if (overlapped) pthread_join(setup_thread, NULL);
+
+    if (sdl != 0 || setup.status != 0) {
+        if (chip8_capture) capture_close(chip8_capture);
+        if (chip8_debug) debug_close(chip8_debug);
+        destroy_sdl();
         return -1;
     }
 
+    if (show_perf) {
+        SDL_SetRenderDrawBlendMode(sdl_renderer, SDL_BLENDMODE_BLEND);
+        chip8_perf = &perf;
+    }
+
     program_loop();
 
+    if (chip8_capture) capture_close(chip8_capture);
+    if (chip8_debug) debug_close(chip8_debug);
     destroy_sdl();
-    chip_clean();
     return 0;
 }
@@ -0,0 +1,122 @@
+#include "perf.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+void perf_start(struct perf *p, uint64_t now) {
+    memset(p, 0, sizeof(*p));
+    p->window_start = now;
+    p->mark = now;
+    p->last.audio_ms = -1;
+}
+
+void perf_phase(struct perf *p, enum perf_phase phase, uint64_t now) {
+    // everything since the last mark belongs to this phase
+    p->phase_ns[phase] += now - p->mark;
+    p->mark = now;
+}
+
+void perf_emulated(struct perf *p, int frames, int cycles) {
+    p->emulated += frames;
+    p->instructions += (uint64_t) frames * cycles;
+}
+
+static int bucket(uint64_t ns) {
+    // the top bit picks the power of two and the next three split it in eight.
+    // below 8ns every nanosecond gets its own bucket
+    if (ns < PERF_SUB_BUCKETS) return ns;
+    int top = 63 - __builtin_clzll(ns);
+    return (top - 2) * PERF_SUB_BUCKETS + ((ns >> (top - 3)) & (PERF_SUB_BUCKETS - 1));
+}
+
+static double bucket_end(int b) {
+    if (b < PERF_SUB_BUCKETS) return b + 1;
+    int top = b / PERF_SUB_BUCKETS + 2;
+    return (double) (PERF_SUB_BUCKETS + b % PERF_SUB_BUCKETS + 1) * (double) (1ull << (top - 3));
+}
+
+void perf_frame(struct perf *p, uint64_t frame_ns) {
+    p->histogram[bucket(frame_ns)]++;
+    if (frame_ns > p->max_ns) p->max_ns = frame_ns;
+    p->frames++;
+}
+
+static double percentile(const struct perf *p, double q) {
+    // upper edge of the bucket the q'th frame falls in, never past the real max
+    uint64_t rank = (uint64_t) (q * p->frames);
+    if (rank >= p->frames) rank = p->frames - 1;
+    uint64_t seen = 0;
+    for (int i=0; i<PERF_BUCKETS; i++) {
+        seen += p->histogram[i];
+        if (seen > rank) {
+            double ns = bucket_end(i);
+            return (ns < p->max_ns ? ns : p->max_ns) / 1e6;
+        }
+    }
+    return p->max_ns / 1e6;
+}
+
+int perf_report(struct perf *p, uint64_t now, double audio_ms) {
+    // 1 when a window just closed and last holds it
+    uint64_t window = now - p->window_start;
+    if (window < PERF_WINDOW_NS || p->frames == 0) return 0;
+
+    struct perf_report *r = &p->last;
+    double seconds = window / 1e9;
+    r->fps = p->frames / seconds;
+    r->emulated_fps = p->emulated / seconds;
+    r->ips = p->instructions / seconds;
+    r->cycles = p->emulated ? (int) (p->instructions / p->emulated) : 0;
+    for (int i=0; i<PERF_PHASES; i++)
+        r->phase_ms[i] = p->phase_ns[i] / 1e6 / p->frames;
+    r->p50_ms = percentile(p, 0.50);
+    r->p99_ms = percentile(p, 0.99);
+    r->max_ms = p->max_ns / 1e6;
+    r->audio_ms = audio_ms;
+
+    memset(p->histogram, 0, sizeof(p->histogram));
+    memset(p->phase_ns, 0, sizeof(p->phase_ns));
+    p->max_ns = 0;
+    p->frames = 0;
+    p->emulated = 0;
+    p->instructions = 0;
+    p->window_start = now;
+    return 1;
+}
+
+void perf_print(const struct perf_report *r, FILE *f, const char *name) {
+    // one json object per line. name is what ran, and may be NULL.
+    // workers share f, so hold it for the whole line
+    flockfile(f);
+    fprintf(f, "{");
+    if (name) {
+        fprintf(f, "\"name\":\"");
+        for (const char *s = name; *s; s++) {
+            if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+            else if ((unsigned char) *s < 0x20) fprintf(f, "\\u%04x", *s);
+            else fputc(*s, f);
+        }
+        fprintf(f, "\",");
+    }
+    fprintf(f, "\"fps\":%.1f,\"emulated_fps\":%.1f,\"ips\":%.0f,\"cycles_per_frame\":%d,"
+            "\"emulate_ms\":%.4f,\"render_ms\":%.4f,\"present_ms\":%.4f,\"sleep_ms\":%.4f,"
+            "\"p50_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f",
+            r->fps, r->emulated_fps, r->ips, r->cycles,
+            r->phase_ms[PERF_EMULATE], r->phase_ms[PERF_RENDER], r->phase_ms[PERF_PRESENT], r->phase_ms[PERF_SLEEP],
+            r->p50_ms, r->p99_ms, r->max_ms);
+    if (r->audio_ms >= 0) fprintf(f, ",\"audio_ms\":%.1f", r->audio_ms);
+    fprintf(f, "}\n");
+    funlockfile(f);
+}
+
+int perf_hud(const struct perf_report *r, char lines[PERF_HUD_LINES][64]) {
+    // the overlay text, returns the number of lines filled
+    snprintf(lines[0], 64, "%5.1f fps  %7.0f ips  %d/frame", r->fps, r->ips, r->cycles);
+    snprintf(lines[1], 64, "emu %6.2f  render %6.2f ms", r->phase_ms[PERF_EMULATE], r->phase_ms[PERF_RENDER]);
+    snprintf(lines[2], 64, "present %6.2f  sleep %6.2f ms", r->phase_ms[PERF_PRESENT], r->phase_ms[PERF_SLEEP]);
+    snprintf(lines[3], 64, "p50 %6.2f  p99 %6.2f  max %6.2f", r->p50_ms, r->p99_ms, r->max_ms);
+    if (r->audio_ms < 0) snprintf(lines[4], 64, "audio off");
+    else snprintf(lines[4], 64, "audio %6.1f ms queued", r->audio_ms);
+    return PERF_HUD_LINES;
+}
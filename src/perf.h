@@ -0,0 +1,58 @@
+#ifndef PERF
+#define PERF
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define PERF_SUB_BUCKETS            8       /* histogram buckets per power of two, about 12% apart */
+#define PERF_BUCKETS                (62 * PERF_SUB_BUCKETS)     /* covers every uint64_t of nanoseconds */
+#define PERF_WINDOW_NS              1000000000  /* stats are reported and reset once a second */
+#define PERF_HUD_LINES              5
+
+enum perf_phase {
+    PERF_EMULATE,
+    PERF_RENDER,
+    PERF_PRESENT,
+    PERF_SLEEP,
+    PERF_PHASES,
+};
+
+/* what one window came to. times are in milliseconds */
+struct perf_report {
+    double fps;                     /* frames shown a second */
+    double emulated_fps;            /* frames emulated a second, more than fps while fast forwarding */
+    double ips;                     /* emulated instructions a second */
+    int cycles;                     /* instructions per emulated frame */
+    double phase_ms[PERF_PHASES];   /* mean per frame shown */
+    double p50_ms;
+    double p99_ms;
+    double max_ms;
+    double audio_ms;                /* sound queued for the device, -1 without audio */
+};
+
+/*
+ * frame timing over a one second window.
+ * the caller hands in monotonic timestamps and everything is kept in fixed
+ * arrays, so recording a frame is a few adds and never allocates.
+ */
+struct perf {
+    uint32_t histogram[PERF_BUCKETS];   /* frame times */
+    uint64_t phase_ns[PERF_PHASES];
+    uint64_t max_ns;
+    uint64_t frames;
+    uint64_t emulated;
+    uint64_t instructions;
+    uint64_t window_start;
+    uint64_t mark;                      /* end of the last phase */
+    struct perf_report last;            /* the last full window */
+};
+
+void perf_start(struct perf *p, uint64_t now);
+void perf_phase(struct perf *p, enum perf_phase phase, uint64_t now);
+void perf_emulated(struct perf *p, int frames, int cycles);
+void perf_frame(struct perf *p, uint64_t frame_ns);
+int perf_report(struct perf *p, uint64_t now, double audio_ms);
+void perf_print(const struct perf_report *r, FILE *f, const char *name);
+int perf_hud(const struct perf_report *r, char lines[PERF_HUD_LINES][64]);
+
+#endif
@@ -0,0 +1,137 @@
+#include "romdb.h"
+#include "chip.h"
+#include "hash.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+uint64_t romdb_hash(const struct chip *c) {
+    return hash64(c->ram + CHIP_8_PROGRAM_START, c->rom_size, 0);
+}
+
+int romdb_default_path(char *buf, size_t size) {
+    const char *home = getenv("HOME");
+    if (!home) return -1;
+    int n = snprintf(buf, size, "%s/%s", home, ROMDB_DEFAULT_FILE);
+    return n < 0 || (size_t) n >= size ? -1 : 0;
+}
+
+int romdb_open(struct romdb *db, const char *path) {
+    memset(db, 0, sizeof(*db));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        // no database yet is the same as an empty one
+        if (errno == ENOENT) return 0;
+        printf("ERROR: Rom database %s could not be loaded.\n", path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct romdb_header)) {
+        printf("ERROR: Rom database %s is not valid.\n", path);
+        close(fd);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        printf("ERROR: Rom database %s could not be mapped.\n", path);
+        return -1;
+    }
+
+    const struct romdb_header *h = map;
+    if (h->magic == ROMDB_MAGIC && h->version != ROMDB_VERSION) {
+        // written by another version. start over, the next save replaces it
+        printf("Ignoring rom database %s from another version.\n", path);
+        munmap(map, st.st_size);
+        return 0;
+    }
+    if (h->magic != ROMDB_MAGIC
+            || h->entry_size != sizeof(struct romdb_entry)
+            || sizeof(*h) + (size_t) h->count * sizeof(struct romdb_entry) > (size_t) st.st_size) {
+        printf("ERROR: Rom database %s is not valid.\n", path);
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    db->map = map;
+    db->map_size = st.st_size;
+    db->entries = (const struct romdb_entry *) (h + 1);
+    db->count = h->count;
+    return 0;
+}
+
+void romdb_close(struct romdb *db) {
+    if (db->map) munmap(db->map, db->map_size);
+    memset(db, 0, sizeof(*db));
+}
+
+const struct romdb_entry *romdb_find(const struct romdb *db, uint64_t hash) {
+    if (!db) return NULL;
+
+    uint32_t lo = 0;
+    uint32_t hi = db->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (db->entries[mid].hash < hash) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < db->count && db->entries[lo].hash == hash ? &db->entries[lo] : NULL;
+}
+
+void romdb_apply(const struct romdb_entry *e, int keep, int *cycles, uint32_t *quirks, uint32_t *palette) {
+    // fill in every setting not in keep. palette may be NULL
+    if (!(keep & ROMDB_CYCLES) && e->cycles_per_frame) *cycles = e->cycles_per_frame;
+    if (!(keep & ROMDB_QUIRKS)) *quirks = e->quirks;
+    if (!(keep & ROMDB_PALETTE) && palette)
+        memcpy(palette, e->palette, sizeof(e->palette));
+}
+
+int romdb_store(const char *path, const struct romdb_entry *entry) {
+    struct romdb db;
+    if (romdb_open(&db, path) != 0) return -1;
+
+    // copy the old entries around the new one, keeping them sorted
+    const struct romdb_entry *old = db.entries;
+    uint32_t at = 0;
+    while (at < db.count && old[at].hash < entry->hash) at++;
+    int replace = at < db.count && old[at].hash == entry->hash;
+
+    struct romdb_header h = {ROMDB_MAGIC, ROMDB_VERSION, db.count + !replace, sizeof(struct romdb_entry)};
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "wb");
+    if (!f) {
+        printf("ERROR: Rom database %s could not be written.\n", tmp);
+        romdb_close(&db);
+        return -1;
+    }
+
+    // with no file yet old is NULL, which fwrite must not see even for 0 entries
+    uint32_t after = db.count - at - replace;
+    int ok = fwrite(&h, sizeof(h), 1, f) == 1
+        && (!at || fwrite(old, sizeof(*old), at, f) == at)
+        && fwrite(entry, sizeof(*entry), 1, f) == 1
+        && (!after || fwrite(old + at + replace, sizeof(*old), after, f) == after);
+    ok = fclose(f) == 0 && ok;
+    romdb_close(&db);
+
+    // swap the new file in whole, so readers never see half of it
+    if (!ok || rename(tmp, path) != 0) {
+        printf("ERROR: Rom database %s could not be written.\n", path);
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef ROMDB
+#define ROMDB
+
+#include "chip.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROMDB_MAGIC                 0x42444357u     /* "WCDB" */
+#define ROMDB_VERSION               2
+#define ROMDB_DEFAULT_FILE          ".woodchip.db"  /* in $HOME */
+
+/* settings, for saying which ones the command line already set */
+#define ROMDB_CYCLES                0x1
+#define ROMDB_QUIRKS                0x2
+#define ROMDB_PALETTE               0x4
+
+/*
+ * per-rom settings, keyed by a hash of the rom's contents.
+ * the file is a header followed by entries sorted by hash, stored in host
+ * byte order, so it can be mapped and binary searched as is.
+ */
+struct romdb_entry {
+    uint64_t hash;
+    uint32_t quirks;            /* CHIP_QUIRK_* flags */
+    uint32_t cycles_per_frame;  /* as -t gives it, which can be well past 16 bits */
+    uint32_t palette[PALETTE_COLORS];   /* 0xRRGGBB, as PALETTE in main.c */
+};
+
+struct romdb_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t entry_size;
+};
+
+struct romdb {
+    const struct romdb_entry *entries;
+    uint32_t count;
+    void *map;
+    size_t map_size;
+};
+
+uint64_t romdb_hash(const struct chip *c);
+int romdb_default_path(char *buf, size_t size);
+int romdb_open(struct romdb *db, const char *path);
+void romdb_close(struct romdb *db);
+const struct romdb_entry *romdb_find(const struct romdb *db, uint64_t hash);
+void romdb_apply(const struct romdb_entry *e, int keep, int *cycles, uint32_t *quirks, uint32_t *palette);
+int romdb_store(const char *path, const struct romdb_entry *entry);
+
+#endif
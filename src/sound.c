@@ -0,0 +1,30 @@
+#include "sound.h"
+#include "macros.h"
+
+#include <math.h>
+#include <stdint.h>
+
+#define SOUND_PI    3.14159265358979f
+
+void sound_fill(struct sound *s, const uint8_t *pattern, uint8_t pitch, float *out, int count) {
+    // pattern is the xo-chip audio pattern, or NULL for the plain chip-8 beep
+    if (pattern) {
+        // step through the 128 bit pattern at 4000 * 2^((pitch - 64) / 48) bits a second
+        const float bit_increment = 4000.0f * powf(2.0f, (pitch - CHIP_8_AUDIO_PITCH) / 48.0f) / (float)SOUND_SAMPLE_RATE;
+        for (int i=0; i<count; i++) {
+            int bit = (int)s->bit;
+            out[i] = (pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? 0.25f : -0.25f;
+            s->bit += bit_increment;
+            if (s->bit >= CHIP_8_AUDIO_PATTERN * 8)
+                s->bit -= CHIP_8_AUDIO_PATTERN * 8;
+        }
+    } else {
+        const float phase_increment = 2.0f * SOUND_PI * SOUND_FREQUENCY / (float)SOUND_SAMPLE_RATE;
+        for (int i=0; i<count; i++) {
+            out[i] = sinf(s->phase);
+            s->phase += phase_increment;
+            if (s->phase >= 2 * SOUND_PI)
+                s->phase -= 2 * SOUND_PI;
+        }
+    }
+}
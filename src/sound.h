@@ -0,0 +1,14 @@
+#ifndef SOUND
+#define SOUND
+
+#include <stdint.h>
+
+/* tone generator state, carried between calls so the wave has no seams */
+struct sound {
+    float phase;    /* sine phase in radians */
+    float bit;      /* position in the xo-chip pattern */
+};
+
+void sound_fill(struct sound *s, const uint8_t *pattern, uint8_t pitch, float *out, int count);
+
+#endif
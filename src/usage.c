@@ -8,4 +8,26 @@ void print_usage() {
     printf("      default: 12\n");
     printf("  -w <value>  Integer scaling of the window.\n");
     printf("      default: 16\n");
+    printf("  -q <value>  Quirk flags, OR'd together:\n");
+    printf("              0x1 8XY1-3 reset VF, 0x2 shifts read VX, 0x4 BNNN jumps to XNN+VX,\n");
+    printf("              0x8 FX65 leaves I unchanged.\n");
+    printf("      default: 0\n");
+    printf("  -c <bg>,<fg>[,<plane 2>,<both planes>]  Colors as hex RRGGBB.\n");
+    printf("      default: 000000,FFFFFF,AAAAAA,555555\n");
+    printf("  -d <file>   Rom database to read settings from.\n");
+    printf("      default: ~/.woodchip.db\n");
+    printf("  -s          Save the settings given for this rom to the rom database.\n");
+    printf("  -g <file>   Serve a debugger on a unix domain socket at file.\n");
+    printf("              in batch mode, worker N listens on <file>.N\n");
+    printf("  -p          Show frame timing on screen, and print it to stderr as json once a second.\n");
+    printf("  -r <file>   Record to <file>.y4m and <file>.wav. Hold tab to fast forward.\n");
+    printf("              in batch mode, file is a directory to record every rom into\n");
+    printf("Batch mode:\n");
+    printf("  -b          Run every rom in file headless and check it against its golden.\n");
+    printf("              file is a directory of .ch8/.c8/.sc8/.xo8 roms, or a manifest with one rom per line.\n");
+    printf("  -f <value>  Number of frames to run each rom for.\n");
+    printf("      default: 600\n");
+    printf("  -j <value>  Number of worker threads.\n");
+    printf("      default: one per core\n");
+    printf("  -u          Write <rom>.golden files instead of comparing against them.\n");
 }
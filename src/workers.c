@@ -0,0 +1,37 @@
+#include "workers.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+
+int workers_start(struct workers *w, int count, void *(*fn)(void *), void *args, size_t size) {
+    // runs fn on workers 1 to count - 1, args being an array of count entries
+    // of size bytes. returns how many workers run, counting the caller's
+    w->count = count;
+    w->threads = calloc(count, sizeof(*w->threads));
+    if (!w->threads) {
+        printf("ERROR: Failed to start worker threads.\n");
+        w->count = 1;
+        return 1;
+    }
+
+    int running = 1;
+    for (int i = 1; i < count; i++) {
+        if (pthread_create(&w->threads[i], NULL, fn, (char *) args + i * size) != 0) {
+            printf("ERROR: Failed to start worker thread.\n");
+            w->threads[i] = pthread_self();
+        } else {
+            running++;
+        }
+    }
+    return running;
+}
+
+void workers_join(struct workers *w) {
+    for (int i = 1; i < w->count; i++) {
+        if (!pthread_equal(w->threads[i], pthread_self()))
+            pthread_join(w->threads[i], NULL);
+    }
+    free(w->threads);
+    w->threads = NULL;
+}
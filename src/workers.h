@@ -0,0 +1,20 @@
+#ifndef WORKERS
+#define WORKERS
+
+#include <stddef.h>
+#include <pthread.h>
+
+/*
+ * threads for a pool of workers. worker 0 is the thread that starts the
+ * pool, the rest get one thread each. a worker whose thread fails to start
+ * never runs, so whatever it owned has to be picked up by the others.
+ */
+struct workers {
+    pthread_t *threads;     /* threads[0] is unused */
+    int count;
+};
+
+int workers_start(struct workers *w, int count, void *(*fn)(void *), void *args, size_t size);
+void workers_join(struct workers *w);
+
+#endif
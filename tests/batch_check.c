@@ -0,0 +1,114 @@
+#include "batch.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * checks that batch results don't depend on how the roms are spread over
+ * workers. goldens are written with one thread and must then pass with
+ * every other thread count, including more threads than roms. a golden
+ * that doesn't match must fail the run.
+ */
+
+#define CHECK_FRAMES        30
+
+struct check_rom {
+    const char *name;
+    const uint8_t *data;
+    size_t size;
+};
+
+static const uint8_t draw_rom[] = {
+    0xA0, 0x50, 0x62, 0x00, 0xD2, 0x25,     // draw the 0 from the font at 0,0
+    0x12, 0x06,                             // spin
+};
+
+static const uint8_t random_rom[] = {
+    0xC0, 0xFF, 0xF0, 0x29,                 // a random digit
+    0xC1, 0x3F, 0xC2, 0x1F, 0xD1, 0x25,     // drawn somewhere random
+    0x12, 0x00,
+};
+
+static const uint8_t halt_rom[] = {
+    0xA0, 0x55, 0xD0, 0x05,                 // draw the 1
+    0x00, 0xFD,                             // and stop
+};
+
+static const struct check_rom roms[] = {
+    {"draw.ch8", draw_rom, sizeof(draw_rom)},
+    {"random.ch8", random_rom, sizeof(random_rom)},
+    {"sub/halt.ch8", halt_rom, sizeof(halt_rom)},
+};
+
+#define CHECK_ROMS          (sizeof(roms) / sizeof(roms[0]))
+
+static int write_file(const char *path, const void *data, size_t size) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+    int ok = fwrite(data, size, 1, f) == 1;
+    return fclose(f) == 0 && ok ? 0 : -1;
+}
+
+static int run(char *dir, int threads, int update, int want) {
+    struct batch_options opts = {
+        .frames = CHECK_FRAMES,
+        .cycles_per_frame = 12,
+        .threads = threads,
+        .update = update,
+    };
+
+    int status = batch_run(dir, &opts);
+    if (status != want) {
+        printf("ERROR: %d threads%s: exit status %d, expected %d.\n",
+                threads, update ? ", updating" : "", status, want);
+        return -1;
+    }
+    return 0;
+}
+
+int main(void) {
+    char dir[] = "/tmp/woodchip-batch-XXXXXX";
+    if (!mkdtemp(dir)) {
+        printf("ERROR: Failed to create a directory for the roms.\n");
+        return 1;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    int failed = mkdir(path, 0700) != 0;
+    for (size_t i = 0; i < CHECK_ROMS && !failed; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, roms[i].name);
+        failed = write_file(path, roms[i].data, roms[i].size) != 0;
+    }
+
+    if (!failed) {
+        failed |= run(dir, 1, 1, 0);
+        failed |= run(dir, 1, 0, 0);
+        failed |= run(dir, 2, 0, 0);
+        failed |= run(dir, 8, 0, 0);
+
+        // a golden from some other run must not pass
+        snprintf(path, sizeof(path), "%s/random.ch8%s", dir, BATCH_GOLDEN_EXT);
+        failed |= write_file(path, "0123456789abcdef\n", 17) != 0;
+        failed |= run(dir, 2, 0, 1);
+    } else {
+        printf("ERROR: Failed to write the roms.\n");
+    }
+
+    for (size_t i = 0; i < CHECK_ROMS; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, roms[i].name);
+        unlink(path);
+        snprintf(path, sizeof(path), "%s/%s%s", dir, roms[i].name, BATCH_GOLDEN_EXT);
+        unlink(path);
+    }
+    snprintf(path, sizeof(path), "%s/sub", dir);
+    rmdir(path);
+    rmdir(dir);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,221 @@
+#include "capture.h"
+#include "chip.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ * checks that a recording keeps its length whatever the writer does.
+ * every frame shows its own number in the top left row. a realtime capture
+ * into a pipe nobody reads fills the ring and has to drop frames. each one
+ * dropped must come out as a copy of the last frame before it, and the
+ * sound must still be one frame's worth per frame. a capture that waits
+ * for the writer must come out whole.
+ */
+
+#define CHECK_FRAMES        400     /* well past the ring and what the pipe and stdio can hold */
+#define CHECK_BITS          16      /* pixels the frame number is drawn in */
+#define CHECK_FRAME_SIZE    (6 + CHIP_8_HIRES_WIDTH * CHIP_8_HIRES_HEIGHT * 3)  /* "FRAME\n" and a picture at scale 1 */
+
+static const uint32_t palette[PALETTE_COLORS] = {0x000000, 0xFFFFFF, 0xAAAAAA, 0x555555};
+
+struct check_buffer {
+    int fd;
+    uint8_t *data;
+    size_t size;
+};
+
+static int read_all(struct check_buffer *b) {
+    size_t cap = 0;
+    for (;;) {
+        if (b->size == cap) {
+            cap = cap ? cap * 2 : 1 << 20;
+            uint8_t *data = realloc(b->data, cap);
+            if (!data) return -1;
+            b->data = data;
+        }
+        ssize_t n = read(b->fd, b->data + b->size, cap - b->size);
+        if (n < 0) return -1;
+        if (n == 0) return 0;
+        b->size += n;
+    }
+}
+
+static void *reader_main(void *arg) {
+    struct check_buffer *b = arg;
+    fcntl(b->fd, F_SETFL, fcntl(b->fd, F_GETFL) & ~O_NONBLOCK);
+    if (read_all(b) != 0) b->size = 0;
+    return NULL;
+}
+
+static void show(struct chip *c, int n) {
+    c->planes[0][0] = (chip_row) n << (CHIP_8_HIRES_WIDTH - CHECK_BITS);
+}
+
+static int check_video(const struct check_buffer *b, const char *name, uint64_t dropped) {
+    // the header is one line, then every frame must be there
+    const uint8_t *end = memchr(b->data, '\n', b->size);
+    size_t header = end ? (size_t) (end - b->data) + 1 : b->size;
+    if (b->size - header != (size_t) CHECK_FRAMES * CHECK_FRAME_SIZE) {
+        printf("ERROR: %s: %zu bytes of frames, expected %d frames.\n", name, b->size - header, CHECK_FRAMES);
+        return -1;
+    }
+
+    uint64_t repeated = 0;
+    int last = -1;
+    for (int k = 0; k < CHECK_FRAMES; k++) {
+        const uint8_t *frame = b->data + header + (size_t) k * CHECK_FRAME_SIZE;
+        if (memcmp(frame, "FRAME\n", 6) != 0) {
+            printf("ERROR: %s: frame %d has no FRAME marker.\n", name, k);
+            return -1;
+        }
+        // first row of the Y plane. white is far above the middle, black far below
+        int n = 0;
+        for (int x = 0; x < CHECK_BITS; x++)
+            n = n << 1 | (frame[6 + x] > 128);
+
+        // a stand in repeats the last frame that made it, never a later one
+        if (n > k || n < last) {
+            printf("ERROR: %s: frame %d shows frame %d after frame %d.\n", name, k, n, last);
+            return -1;
+        }
+        if (n != k) repeated++;
+        last = n;
+    }
+
+    if (repeated != dropped) {
+        printf("ERROR: %s: %llu frames repeated but %llu dropped.\n", name,
+                (unsigned long long) repeated, (unsigned long long) dropped);
+        return -1;
+    }
+    printf("%s: %d frames, %llu repeated\n", name, CHECK_FRAMES, (unsigned long long) repeated);
+    return 0;
+}
+
+static int check_audio(const char *base, const char *name) {
+    // one frame of samples per frame, and the sizes patched in on close
+    char path[4096];
+    snprintf(path, sizeof(path), "%s.wav", base);
+    FILE *f = fopen(path, "rb");
+    uint8_t h[44];
+    int ok = f && fread(h, sizeof(h), 1, f) == 1;
+    long size = ok && fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+    if (f) fclose(f);
+
+    uint32_t want = CHECK_FRAMES * CAPTURE_SAMPLES * 2;
+    uint32_t data = ok ? h[40] | h[41] << 8 | h[42] << 16 | (uint32_t) h[43] << 24 : 0;
+    if (!ok || data != want || size != (long) sizeof(h) + want) {
+        printf("ERROR: %s: the wav holds %u bytes of samples, expected %u.\n", name, data, want);
+        return -1;
+    }
+    return 0;
+}
+
+static int check_realtime(const char *dir, struct capture *cap, struct chip *c) {
+    char base[256];
+    char path[4096];
+    snprintf(base, sizeof(base), "%s/realtime", dir);
+    snprintf(path, sizeof(path), "%s.y4m", base);
+
+    // the read end is opened first so opening for write doesn't block, then
+    // left alone so the writer stalls on a full pipe
+    struct check_buffer b = {-1, NULL, 0};
+    if (mkfifo(path, 0600) != 0 || (b.fd = open(path, O_RDONLY | O_NONBLOCK)) < 0) {
+        printf("ERROR: Failed to make a pipe to record into.\n");
+        unlink(path);
+        return -1;
+    }
+    if (capture_open(cap, base, 1, palette, 1) != 0) {
+        close(b.fd);
+        unlink(path);
+        return -1;
+    }
+
+    for (int n = 0; n < CHECK_FRAMES; n++) {
+        show(c, n);
+        capture_frame(cap, c);
+    }
+    uint64_t dropped = cap->dropped;
+
+    pthread_t reader;
+    int failed = pthread_create(&reader, NULL, reader_main, &b) != 0;
+    if (failed) {
+        // nothing would ever drain the pipe, so the writer could never finish
+        printf("ERROR: Failed to start the reader thread.\n");
+        close(b.fd);
+        b.fd = -1;
+    }
+    capture_close(cap);
+    if (!failed) pthread_join(reader, NULL);
+
+    if (!failed && dropped == 0) {
+        printf("ERROR: realtime: the writer never fell behind.\n");
+        failed = 1;
+    }
+    if (!failed) failed = check_video(&b, "realtime", dropped) != 0 || check_audio(base, "realtime") != 0;
+
+    if (b.fd >= 0) close(b.fd);
+    free(b.data);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s.wav", base);
+    unlink(path);
+    return failed ? -1 : 0;
+}
+
+static int check_waiting(const char *dir, struct capture *cap, struct chip *c) {
+    char base[256];
+    char path[4096];
+    snprintf(base, sizeof(base), "%s/waiting", dir);
+    if (capture_open(cap, base, 1, palette, 0) != 0) return -1;
+
+    for (int n = 0; n < CHECK_FRAMES; n++) {
+        show(c, n);
+        capture_frame(cap, c);
+    }
+    uint64_t dropped = cap->dropped;
+    capture_close(cap);
+
+    snprintf(path, sizeof(path), "%s.y4m", base);
+    struct check_buffer b = {open(path, O_RDONLY), NULL, 0};
+    int failed = b.fd < 0 || read_all(&b) != 0;
+    if (failed) printf("ERROR: waiting: the recording could not be read back.\n");
+    if (!failed && dropped != 0) {
+        printf("ERROR: waiting: %llu frames dropped.\n", (unsigned long long) dropped);
+        failed = 1;
+    }
+    if (!failed) failed = check_video(&b, "waiting", 0) != 0 || check_audio(base, "waiting") != 0;
+
+    if (b.fd >= 0) close(b.fd);
+    free(b.data);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s.wav", base);
+    unlink(path);
+    return failed ? -1 : 0;
+}
+
+int main(void) {
+    char dir[] = "/tmp/woodchip-capture-XXXXXX";
+    if (!mkdtemp(dir)) {
+        printf("ERROR: Failed to create a directory to record into.\n");
+        return 1;
+    }
+
+    static struct capture cap;
+    static struct chip c;
+    chip_reset(&c, 1);
+    c.hires = 1;
+
+    int failed = 0;
+    failed |= check_realtime(dir, &cap, &c);
+    failed |= check_waiting(dir, &cap, &c);
+
+    rmdir(dir);
+    return failed ? 1 : 0;
+}
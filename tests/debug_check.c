@@ -0,0 +1,234 @@
+#include "chip.h"
+#include "debug.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+/*
+ * checks the debugger over its socket.
+ * a machine runs the rom below on its own thread, under chip_run, while
+ * this acts as the client. every command's answer is compared in full, so
+ * a breakpoint or watchpoint that stops at the wrong place, or not at all,
+ * fails. a wait that never answers times out.
+ */
+
+#define CHECK_CYCLES        12
+#define CHECK_TIMEOUT       5       /* seconds to wait for any answer */
+
+static const uint8_t rom[] = {
+    // 200: idle loop
+    0x70, 0x01,                 // ADD V0, 01
+    0x12, 0x00,                 // JP 200
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 210: FX55 over 300
+    0xA3, 0x00,                 // LD I, 300
+    0xF1, 0x55,                 // LD [I], V1
+    0x12, 0x14,                 // JP 214
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 220: FX33 over 302
+    0xA3, 0x02,                 // LD I, 302
+    0xF0, 0x33,                 // LD B, V0
+    0x12, 0x24,                 // JP 224
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 230: rewrites 23C, further down its own block, into JP 240
+    0x60, 0x12,                 // LD V0, 12
+    0x61, 0x40,                 // LD V1, 40
+    0xA2, 0x3C,                 // LD I, 23C
+    0xF1, 0x55,                 // LD [I], V1
+    0x62, 0x05,                 // LD V2, 05
+    0x62, 0x06,                 // LD V2, 06
+    0x63, 0x00,                 // LD V3, 00, until it becomes JP 240
+    0x12, 0x3E,                 // JP 23E
+    // 240: only reachable through the rewritten jump
+    0x64, 0x01,                 // LD V4, 01
+    0x12, 0x42,                 // JP 242
+};
+
+struct check_client {
+    int fd;
+    char buf[DEBUG_REPLY_MAX];
+    size_t used;
+};
+
+static struct chip machine;
+static struct debug debugger;
+static _Atomic int running = 1;
+
+static void *machine_main(void *arg) {
+    (void) arg;
+    while (atomic_load(&running)) {
+        chip_run(&machine, CHECK_CYCLES, &debugger);
+        decrement_timers(&machine);
+    }
+    return NULL;
+}
+
+static int read_line(struct check_client *cl, char *line, size_t size) {
+    for (;;) {
+        char *nl = memchr(cl->buf, '\n', cl->used);
+        if (nl) {
+            size_t n = nl - cl->buf;
+            snprintf(line, size, "%.*s", (int) n, cl->buf);
+            cl->used -= n + 1;
+            memmove(cl->buf, nl + 1, cl->used);
+            return 0;
+        }
+        if (cl->used == sizeof(cl->buf)) return -1;
+        ssize_t got = recv(cl->fd, cl->buf + cl->used, sizeof(cl->buf) - cl->used, 0);
+        if (got <= 0) return -1;
+        cl->used += got;
+    }
+}
+
+static int expect(struct check_client *cl, const char *cmd, const char **want) {
+    // sends cmd and compares the whole answer. want ends with NULL
+    char out[DEBUG_LINE_MAX];
+    int n = snprintf(out, sizeof(out), "%s\n", cmd);
+    if (send(cl->fd, out, n, MSG_NOSIGNAL) != n) {
+        printf("ERROR: %s: could not be sent.\n", cmd);
+        return -1;
+    }
+
+    for (int i = 0; want[i]; i++) {
+        char line[DEBUG_LINE_MAX];
+        if (read_line(cl, line, sizeof(line)) != 0) {
+            printf("ERROR: %s: no answer, expected \"%s\".\n", cmd, want[i]);
+            return -1;
+        }
+        if (strcmp(line, want[i]) != 0) {
+            printf("ERROR: %s: answered \"%s\", expected \"%s\".\n", cmd, line, want[i]);
+            return -1;
+        }
+    }
+    printf("%s: %s\n", cmd, want[0]);
+    return 0;
+}
+
+#define EXPECT(cl, cmd, ...)    expect(cl, cmd, (const char *[]) {__VA_ARGS__, NULL})
+
+static int session(struct check_client *cl) {
+    int failed = 0;
+
+    failed |= EXPECT(cl, "info", "debug_check running", "OK");
+    failed |= EXPECT(cl, "regs", "ERROR running, pause first");
+    failed |= EXPECT(cl, "pause", "OK");
+    if (EXPECT(cl, "wait", "STOPPED pause 0200 0200") != 0) {
+        // pause stops at a block, and the loop is a single block at 200
+        return -1;
+    }
+    failed |= EXPECT(cl, "info", "debug_check stopped", "OK");
+
+    // breakpoints stop before the instruction runs
+    failed |= EXPECT(cl, "break 202", "OK");
+    failed |= EXPECT(cl, "disasm 200 2", "0200  7001  ADD V0, 01", "0202  1200  JP 200  *", "OK");
+    failed |= EXPECT(cl, "set v0 41", "OK");
+    failed |= EXPECT(cl, "continue", "OK");
+    failed |= EXPECT(cl, "wait", "STOPPED break 0202 0202");
+    failed |= EXPECT(cl, "regs",
+            "pc=0202 i=0000 sp=F dt=00 st=00 plane=1 hires=0"
+            " v0=42 v1=00 v2=00 v3=00 v4=00 v5=00 v6=00 v7=00"
+            " v8=00 v9=00 va=00 vb=00 vc=00 vd=00 ve=00 vf=00", "OK");
+    failed |= EXPECT(cl, "delete 202", "OK");
+
+    // one instruction at a time
+    failed |= EXPECT(cl, "step", "OK");
+    failed |= EXPECT(cl, "wait", "STOPPED step 0200 0200");
+    failed |= EXPECT(cl, "step 2", "OK");
+    failed |= EXPECT(cl, "wait", "STOPPED step 0200 0200");
+    failed |= EXPECT(cl, "read 200 1", "70", "OK");
+
+    // FX55 writes V0-V1, the watch on the second byte catches it
+    failed |= EXPECT(cl, "set v1 99", "OK");
+    failed |= EXPECT(cl, "set pc 210", "OK");
+    failed |= EXPECT(cl, "watch 301", "OK");
+    failed |= EXPECT(cl, "continue", "OK");
+    failed |= EXPECT(cl, "wait", "STOPPED watch 0212 0301");
+    failed |= EXPECT(cl, "unwatch 301", "OK");
+    failed |= EXPECT(cl, "step", "OK");
+    failed |= EXPECT(cl, "wait", "STOPPED step 0214 0214");
+    failed |= EXPECT(cl, "read 300 2", "43 99", "OK");
+
+    // FX33 writes three digits, watched from the middle of a range
+    failed |= EXPECT(cl, "set v0 FE", "OK");
+    failed |= EXPECT(cl, "set pc 220", "OK");
+    failed |= EXPECT(cl, "watch 303 10", "OK");
+    failed |= EXPECT(cl, "continue", "OK");
+    failed |= EXPECT(cl, "wait", "STOPPED watch 0222 0303");
+    failed |= EXPECT(cl, "unwatch 303 10", "OK");
+    failed |= EXPECT(cl, "step", "OK");
+    failed |= EXPECT(cl, "wait", "STOPPED step 0224 0224");
+    failed |= EXPECT(cl, "read 302 3", "02 05 04", "OK");
+
+    // the breakpoint is outside the block as scanned. only a rescan after
+    // the block rewrites itself into a jump there can stop on it
+    failed |= EXPECT(cl, "break 240", "OK");
+    failed |= EXPECT(cl, "set pc 230", "OK");
+    failed |= EXPECT(cl, "continue", "OK");
+    failed |= EXPECT(cl, "wait", "STOPPED break 0240 0240");
+    failed |= EXPECT(cl, "disasm 23C 1", "023C  1240  JP 240", "OK");
+    failed |= EXPECT(cl, "delete 240", "OK");
+
+    // code written over the socket runs
+    failed |= EXPECT(cl, "write 240 6577", "OK");
+    failed |= EXPECT(cl, "step", "OK");
+    failed |= EXPECT(cl, "wait", "STOPPED step 0242 0242");
+    failed |= EXPECT(cl, "read 240 2", "65 77", "OK");
+
+    // bad input is answered, not acted on
+    failed |= EXPECT(cl, "set vg 1", "ERROR bad register or value");
+    failed |= EXPECT(cl, "write 240 657", "ERROR usage: write <addr> <hex bytes>");
+    failed |= EXPECT(cl, "frobnicate", "ERROR unknown command frobnicate");
+
+    failed |= EXPECT(cl, "continue", "OK");
+    return failed ? -1 : 0;
+}
+
+int main(void) {
+    char path[] = "/tmp/woodchip-debug-XXXXXX";
+    int tmp = mkstemp(path);
+    if (tmp < 0) {
+        printf("ERROR: Failed to pick a socket path.\n");
+        return 1;
+    }
+    close(tmp);
+    unlink(path);
+
+    chip_reset(&machine, 1);
+    if (chip_load(&machine, rom, sizeof(rom)) != 0 || debug_open(&debugger, path) != 0) return 1;
+    debug_attach(&debugger, "debug_check");
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, machine_main, NULL) != 0) {
+        printf("ERROR: Failed to start the machine.\n");
+        debug_close(&debugger);
+        return 1;
+    }
+
+    static struct check_client cl;
+    struct sockaddr_un addr = {0};
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    struct timeval timeout = {CHECK_TIMEOUT, 0};
+    cl.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int failed = cl.fd < 0
+        || setsockopt(cl.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0
+        || connect(cl.fd, (struct sockaddr *) &addr, sizeof(addr)) != 0;
+    if (failed) printf("ERROR: Failed to connect to the debugger.\n");
+    else failed = session(&cl) != 0;
+
+    // hanging up lets a stopped machine go
+    if (cl.fd >= 0) close(cl.fd);
+    atomic_store(&running, 0);
+    pthread_join(thread, NULL);
+    debug_close(&debugger);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,108 @@
+#include "chip.h"
+#include "explore.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * checks the input search end to end.
+ * the rom is a lock that only opens for keys 5, A and 3 in that order, then
+ * draws a 0 in the top left corner and spins. every search order must find
+ * exactly that path, whether the target is the spin loop (a predicate) or
+ * the drawn 0 (a pattern), and nothing shorter than three inputs may open it.
+ */
+
+#define CHECK_THREADS       2
+#define CHECK_OPEN          0x218   /* pc of the loop after the lock opens */
+
+static const uint8_t lock_rom[] = {
+    0x60, 0x05, 0xE0, 0x9E, 0x12, 0x02,     // wait for 5
+    0x60, 0x0A, 0xE0, 0x9E, 0x12, 0x08,     // then A
+    0x60, 0x03, 0xE0, 0x9E, 0x12, 0x0E,     // then 3
+    0xA0, 0x50, 0x62, 0x00, 0xD2, 0x25,     // draw the 0 from the font at 0,0
+    0x12, 0x18,
+};
+
+static const uint8_t lock_path[] = {0x5, 0xA, 0x3};
+
+static int is_open(const struct chip *c, void *user) {
+    (void) user;
+    return c->pc == CHECK_OPEN;
+}
+
+static int distance(const struct chip *c, void *user) {
+    // every gate passed moves pc further along
+    (void) user;
+    return CHECK_OPEN - c->pc;
+}
+
+static int check(const struct chip *start, const char *name, enum explore_order order,
+        explore_predicate target, void *target_user, int max_depth, int want_found) {
+    static struct explore_result result;
+    struct explore_options opts = {
+        .frames_per_input = 2,
+        .cycles_per_frame = 12,
+        .max_depth = max_depth,
+        .max_states = 4096,
+        .max_frontier = 512,
+        .threads = CHECK_THREADS,
+        .order = order,
+        .target = target,
+        .target_user = target_user,
+        .score = order == EXPLORE_BEST_FIRST && target == is_open ? distance : NULL,
+    };
+
+    if (explore(start, &opts, &result) != 0) {
+        printf("ERROR: %s: search failed to run.\n", name);
+        return -1;
+    }
+
+    printf("%s: %s", name, result.found ? "found" : "not found");
+    for (int i = 0; i < result.depth; i++)
+        printf(" %X", result.path[i]);
+    printf(" (%ld states, %ld duplicates)\n", result.states, result.duplicates);
+
+    if (!want_found) {
+        if (!result.found) return 0;
+        printf("ERROR: %s: found a path shorter than the lock.\n", name);
+        return -1;
+    }
+    if (!result.found || result.depth != sizeof(lock_path)
+            || memcmp(result.path, lock_path, sizeof(lock_path)) != 0) {
+        printf("ERROR: %s: expected 5 A 3.\n", name);
+        return -1;
+    }
+    if (!target(&result.state, target_user)) {
+        printf("ERROR: %s: the returned state is not the target.\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+int main(void) {
+    static struct chip start;
+    chip_reset(&start, 1);
+    if (chip_load(&start, lock_rom, sizeof(lock_rom)) != 0) return 1;
+
+    // the top row of the 0 glyph, four pixels wide
+    static struct explore_pattern zero;
+    for (int x = 0; x < 4; x++) {
+        zero.planes[0][0] |= CHIP_ROW_BIT(x);
+        zero.mask[0][0] |= CHIP_ROW_BIT(x);
+    }
+
+    int failed = 0;
+    failed |= check(&start, "breadth-first, predicate", EXPLORE_BREADTH_FIRST, is_open, NULL, 8, 1);
+    failed |= check(&start, "breadth-first, pattern", EXPLORE_BREADTH_FIRST, explore_pattern_match, &zero, 8, 1);
+    failed |= check(&start, "best-first, predicate", EXPLORE_BEST_FIRST, is_open, NULL, 8, 1);
+    failed |= check(&start, "best-first, pattern", EXPLORE_BEST_FIRST, explore_pattern_match, &zero, 8, 1);
+    failed |= check(&start, "breadth-first, too shallow", EXPLORE_BREADTH_FIRST, is_open, NULL, 2, 0);
+    failed |= check(&start, "best-first, too shallow", EXPLORE_BEST_FIRST, explore_pattern_match, &zero, 2, 0);
+    failed |= check(&start, "breadth-first, negative depth", EXPLORE_BREADTH_FIRST, is_open, NULL, -1, 0);
+    failed |= check(&start, "best-first, negative depth", EXPLORE_BEST_FIRST, is_open, NULL, -1, 0);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,97 @@
+#include "perf.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * checks the frame time histogram through the percentiles it reports.
+ * a percentile is the upper edge of the bucket its frame fell in, so a
+ * window of one frame time and one much longer frame reports that edge
+ * as p50. every bucket must hold the time it was given, be no wider than
+ * an eighth of it, and split exactly at the powers of two.
+ */
+
+#define CHECK_FRAMES        100
+#define CHECK_LONG_FRAME    (1ull << 62)    /* past every edge we look at, so nothing is clamped */
+
+static struct perf perf;
+
+static double p50_ns(uint64_t ns, uint64_t longest) {
+    // the upper edge of the bucket ns falls in, unless longest is below it
+    perf_start(&perf, 0);
+    for (int i = 0; i < CHECK_FRAMES; i++)
+        perf_frame(&perf, ns);
+    perf_frame(&perf, longest);
+    perf_report(&perf, PERF_WINDOW_NS, -1);
+    return perf.last.p50_ms * 1e6;
+}
+
+static int check_edge(uint64_t ns, double want) {
+    double got = p50_ns(ns, CHECK_LONG_FRAME);
+    if (got == want) return 0;
+    printf("ERROR: %llu ns is in a bucket ending at %.0f ns, expected %.0f.\n", (unsigned long long) ns, got, want);
+    return -1;
+}
+
+static int check_width(uint64_t ns) {
+    double end = p50_ns(ns, CHECK_LONG_FRAME);
+    double width = ns < 8 ? 1 : (double) (ns & ~7ull) / 8;
+    if (end > ns && end <= ns + width) return 0;
+    printf("ERROR: %llu ns is in a bucket ending at %.0f ns.\n", (unsigned long long) ns, end);
+    return -1;
+}
+
+int main(void) {
+    int failed = 0;
+
+    // below 8ns every nanosecond is its own bucket
+    for (uint64_t ns = 0; ns < 8; ns++)
+        failed |= check_edge(ns, ns + 1);
+
+    // a power of two starts a bucket an eighth of it wide, the one below ends there
+    for (int top = 3; top < 62; top++) {
+        uint64_t ns = 1ull << top;
+        failed |= check_edge(ns, ns + ns / 8);
+        if (top > 3) failed |= check_edge(ns - 1, ns);
+    }
+
+    // everything in between, at a spread of scales
+    for (uint64_t ns = 1; ns < CHECK_LONG_FRAME / 2; ns = ns * 1.01 + 1)
+        failed |= check_width(ns);
+
+    // the largest time still lands in the histogram
+    perf_start(&perf, 0);
+    perf_frame(&perf, UINT64_MAX);
+    if (perf.histogram[PERF_BUCKETS - 1] != 1) {
+        printf("ERROR: the longest frame time is not in the last bucket.\n");
+        failed = -1;
+    }
+
+    // never past the longest frame seen
+    if (p50_ns(1000, 1000) != 1000) {
+        printf("ERROR: a percentile went past the longest frame.\n");
+        failed = -1;
+    }
+
+    // p99 is the frame below which 99% of them fall
+    perf_start(&perf, 0);
+    for (int i = 0; i < 98; i++)
+        perf_frame(&perf, 16000000);
+    perf_frame(&perf, 40000000);
+    perf_frame(&perf, 40000000);
+    if (perf_report(&perf, PERF_WINDOW_NS - 1, -1)) {
+        printf("ERROR: a window closed early.\n");
+        failed = -1;
+    }
+    perf_report(&perf, PERF_WINDOW_NS, -1);
+    if (perf.last.p99_ms != 40.0 || perf.last.p50_ms < 16.0 || perf.last.p50_ms > 18.0 || perf.last.max_ms != 40.0) {
+        printf("ERROR: p50 %.4f p99 %.4f max %.4f ms for 98 frames of 16ms and 2 of 40ms.\n",
+                perf.last.p50_ms, perf.last.p99_ms, perf.last.max_ms);
+        failed = -1;
+    }
+
+    if (!failed) printf("perf histogram: ok\n");
+    return failed ? 1 : 0;
+}
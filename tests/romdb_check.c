@@ -0,0 +1,106 @@
+#include "chip.h"
+#include "romdb.h"
+#include "macros.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * checks the rom database end to end.
+ * entries are stored out of order and one is stored twice, then the file is
+ * mapped again and looked up by the hash of a loaded rom. a rom that was
+ * never stored, and hashes below, between and above the stored ones, must
+ * all miss. settings given on the command line must win over the entry.
+ */
+
+static const uint8_t stored_rom[] = {0xA0, 0x50, 0x62, 0x00, 0xD2, 0x25, 0x12, 0x06};
+static const uint8_t other_rom[] = {0x00, 0xE0, 0x12, 0x00};
+
+static int check(int ok, const char *what) {
+    if (ok) return 0;
+    printf("ERROR: %s.\n", what);
+    return -1;
+}
+
+static struct romdb_entry entry(uint64_t hash, uint32_t cycles) {
+    struct romdb_entry e = {0};
+    e.hash = hash;
+    e.cycles_per_frame = cycles;
+    e.quirks = CHIP_QUIRK_SHIFT;
+    for (int i = 0; i < PALETTE_COLORS; i++) e.palette[i] = 0x102030 * i;
+    return e;
+}
+
+int main(void) {
+    static struct chip c;
+    chip_reset(&c, 1);
+    if (chip_load(&c, stored_rom, sizeof(stored_rom)) != 0) return 1;
+    uint64_t hash = romdb_hash(&c);
+
+    char path[] = "/tmp/woodchip-romdb-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        printf("ERROR: Failed to create a rom database.\n");
+        return 1;
+    }
+    close(fd);
+    // an empty file is not a database, start from none
+    unlink(path);
+
+    struct romdb_entry high = entry(hash | 0x8000000000000000ull, 30);
+    struct romdb_entry low = entry(hash & 0x7fffffffffffffffull, 20);
+    struct romdb_entry mine = entry(hash, 5);
+    if (high.hash == hash) high.hash = UINT64_MAX;
+    if (low.hash == hash) low.hash = 0;
+
+    int failed = 0;
+    failed |= check(romdb_store(path, &high) == 0, "storing the first entry failed");
+    failed |= check(romdb_store(path, &mine) == 0, "storing the second entry failed");
+    failed |= check(romdb_store(path, &low) == 0, "storing the third entry failed");
+    // more than 16 bits of cycles, which must come back whole
+    mine.cycles_per_frame = 100000;
+    failed |= check(romdb_store(path, &mine) == 0, "storing an entry again failed");
+
+    struct romdb db;
+    if (!failed && romdb_open(&db, path) == 0) {
+        failed |= check(db.count == 3, "storing an entry again added a second one");
+        for (uint32_t i = 1; i < db.count; i++)
+            failed |= check(db.entries[i - 1].hash < db.entries[i].hash, "entries are not sorted");
+
+        // found by the hash of the loaded rom, with the settings stored last
+        const struct romdb_entry *e = romdb_find(&db, hash);
+        failed |= check(e && e->cycles_per_frame == 100000, "the stored rom was not found");
+        failed |= check(romdb_find(&db, low.hash) && romdb_find(&db, high.hash), "an entry at either end was not found");
+
+        chip_reset(&c, 1);
+        chip_load(&c, other_rom, sizeof(other_rom));
+        uint64_t other = romdb_hash(&c);
+        failed |= check(other == hash || !romdb_find(&db, other), "a rom never stored was found");
+        failed |= check(low.hash == 0 || !romdb_find(&db, 0), "a hash below every entry was found");
+        failed |= check(high.hash == UINT64_MAX || !romdb_find(&db, UINT64_MAX), "a hash above every entry was found");
+        failed |= check(hash - 1 == low.hash || !romdb_find(&db, hash - 1), "a hash between entries was found");
+        failed |= check(!romdb_find(NULL, hash), "a lookup without a database found something");
+
+        if (e) {
+            // the command line set the cycles, the rest comes from the entry
+            int cycles = 12;
+            uint32_t quirks = 0;
+            uint32_t palette[PALETTE_COLORS] = {0};
+            romdb_apply(e, ROMDB_CYCLES, &cycles, &quirks, palette);
+            failed |= check(cycles == 12, "the entry overrode the command line");
+            failed |= check(quirks == CHIP_QUIRK_SHIFT && memcmp(palette, e->palette, sizeof(palette)) == 0,
+                    "the entry's settings were not applied");
+        }
+        romdb_close(&db);
+    } else {
+        failed = 1;
+        printf("ERROR: The rom database could not be read back.\n");
+    }
+
+    unlink(path);
+    if (!failed) printf("rom database: ok\n");
+    return failed ? 1 : 0;
+}